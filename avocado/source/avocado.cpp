@@ -27,7 +27,6 @@ Avocado is a bit crusher, distortion, resampler and mangler.
 #include "DistrhoPlugin.hpp"
 #include "avocado.hpp"
 #include "math.h"
-#include "stdlib.h"
 
 void AvocadoPlugin::initProgramName(uint32_t index, String& programName) {
     switch (index) {
@@ -60,7 +59,55 @@ void AvocadoPlugin::initParameter(uint32_t index, Parameter& parameter) {
             parameter.unit = "ms";
             parameter.ranges.def = 50;
             parameter.ranges.min = 10;
-            parameter.ranges.max = 250;
+            parameter.ranges.max = MAX_BUF_MS;
+            break;
+
+        case PARAM_SEED:
+            parameter.hints = kParameterIsAutomable | kParameterIsInteger;
+            parameter.name = "Seed";
+            parameter.symbol = "seed";
+            parameter.unit = "";
+            parameter.ranges.def = 0;
+            parameter.ranges.min = 0;
+            parameter.ranges.max = 9999;
+            break;
+
+        case PARAM_VOICES:
+            parameter.hints = kParameterIsAutomable | kParameterIsInteger;
+            parameter.name = "Voices";
+            parameter.symbol = "voices";
+            parameter.unit = "";
+            parameter.ranges.def = 1;
+            parameter.ranges.min = 1;
+            parameter.ranges.max = MAX_VOICES;
+            break;
+
+        case PARAM_SLICES:
+            parameter.hints = kParameterIsAutomable | kParameterIsInteger;
+            parameter.name = "Slices";
+            parameter.symbol = "slices";
+            parameter.unit = "";
+            parameter.ranges.def = 5;
+            parameter.ranges.min = 1;
+            parameter.ranges.max = MAX_BUFFERS;
+            break;
+
+        case PARAM_SPREAD:
+            parameter.name = "Spread";
+            parameter.symbol = "spread";
+            parameter.unit = "st";
+            parameter.ranges.def = 0;
+            parameter.ranges.min = 0;
+            parameter.ranges.max = MAX_SPREAD;
+            break;
+
+        case PARAM_FADE:
+            parameter.name = "Fade";
+            parameter.symbol = "fade";
+            parameter.unit = "ms";
+            parameter.ranges.def = 2.5;
+            parameter.ranges.min = 0;
+            parameter.ranges.max = MAX_FADE_MS;
             break;
     }
 
@@ -79,6 +126,21 @@ float AvocadoPlugin::getParameterValue(uint32_t index) const {
         case PARAM_BUF_LENGTH:
             return int(1000.0 * buffer_size_ / srate);
 
+        case PARAM_SEED:
+            return seed_;
+
+        case PARAM_VOICES:
+            return voice_count_;
+
+        case PARAM_SLICES:
+            return buffer_count_;
+
+        case PARAM_SPREAD:
+            return spread_;
+
+        case PARAM_FADE:
+            return fade_ms_;
+
         default:
             return 0;
     }
@@ -94,10 +156,78 @@ void AvocadoPlugin::setParameterValue(uint32_t index, float value) {
     switch (index) {
 
         case PARAM_BUF_LENGTH:
-            buffer_size_ = value * srate / 1000.0;
+            buffer_ms_ = fmin(value, MAX_BUF_MS);
+            fixBufferSize();
+            break;
+
+        case PARAM_SEED:
+            seed_ = value;
+            rng_.seed(seed_);
+            break;
+
+        case PARAM_VOICES:
+        {
+            const int count = fmin(fmax(value, 1), MAX_VOICES);
+            if (count > voice_count_) {
+                const int first = voice_count_;
+                voice_count_ = count;
+                staggerVoices(first);
+            }
+            voice_count_ = count;
+            // uncorrelated slices add in power
+            voice_gain_ = 1.0 / sqrt(voice_count_);
+            break;
+        }
+
+        case PARAM_SLICES:
+            buffer_count_ = fmin(fmax(value, 1), MAX_BUFFERS);
+            // keep the voices on slices that still exist. a slot that comes
+            // back keeps its old start, which startSlice() swaps for the
+            // latest slice if it's gone from the history.
+            for (int v = 0; v < MAX_VOICES; ++v) {
+                voices_.slot[v] %= buffer_count_;
+            }
             break;
 
+        case PARAM_SPREAD:
+            spread_ = fmin(fmax(value, 0), MAX_SPREAD);
+            break;
+
+        case PARAM_FADE:
+            fade_ms_ = fmin(fmax(value, 0), MAX_FADE_MS);
+            break;
+
+    }
+}
+
+void AvocadoPlugin::sampleRateChanged(double newSampleRate) {
+    srate = newSampleRate;
+    fixBufferSize();
+}
+
+void AvocadoPlugin::fixBufferSize() {
+    buffer_size_ = buffer_ms_ * srate / 1000.0;
+}
+
+void AvocadoPlugin::activate() {
+    // the host may have changed the rate since construction.
+    srate = getSampleRate();
+    fixBufferSize();
+
+    // record/playback run up to buffer_size_ inclusive, hence the +1. hold
+    // every slot's slice at the longest Time, one more for a voice at the
+    // lowest rate falling behind, and the run record() keeps ahead of
+    // playback(), so no slot is dropped for want of history.
+    left_.allocate((MAX_BUFFERS + 1) * (int) (MAX_BUF_MS * srate / 1000.0 + 1) + SEGMENT_LEN);
+    for (int i = 0; i < MAX_BUFFERS; ++i) {
+        slice_start_[i] = 0;
     }
+    latest_slice_ = 0;
+    record_csr_ = 0;
+    staggerVoices(0);
+    leaky_integrator = 0;
+    gain_ = 0;
+    rng_.seed(seed_);
 }
 
 /**
@@ -107,83 +237,175 @@ void AvocadoPlugin::run(const float** inputs, float** outputs, uint32_t frames)
     const float* const left_input = inputs[0];
     /* */ float* const left_output = outputs[0];
 
-    for (uint32_t i = 0; i < frames; ++i) {
-        left_output[i] = process(left_, left_input[i]);
+    for (uint32_t i = 0; i < frames; i += SEGMENT_LEN) {
+        const int n = fmin(frames - i, SEGMENT_LEN);
+        process(left_, left_input + i, left_output + i, n);
         tick();
     }
 }
 
-void AvocadoPlugin::record(Channel& ch, const signal_t in) {
+void AvocadoPlugin::staggerVoices(const int first) {
+    // spread the voices' slice edges evenly over one slice length. the
+    // first voice starts at once, on the first buffer.
+    for (int v = first; v < voice_count_; ++v) {
+        voices_.slot[v] = v % buffer_count_;
+        voices_.play[v] = 0;
+        voices_.csr[v] = -(v * (buffer_size_ + 1) / voice_count_);
+    }
+}
+
+void AvocadoPlugin::record(Channel& ch, const signal_t* in, const int n) {
 
     /*
     record:
-      if not recording and rnd() > ?, start recording else stop recording.
-      if recording, add to buffer. if buffer full, stop recording.
+      always add to history. when a slice's worth has gone by, point a
+      random buffer at it.
      */
+    ch.writeBlock(in, n);
+    record_csr_ += n;
+    if (record_csr_ > buffer_size_) {
+        commitSlice(ch);
+    }
+}
 
-    if (is_recording_) {
-        ch.buffer[record_buffer_][record_csr_] = in;
-        record_csr_ += 1;
-        if (record_csr_ > buffer_size_) {
-            // hit end of buffer
-            is_recording_ = false;
-        }
-    } else {
-        // start recording
-        record_buffer_ = rand() % buffer_count_;
-        if (record_buffer_ == playback_buffer_) {
-            record_buffer_ = (record_buffer_ + 1) % buffer_count_;
-        }
-        record_csr_ = 0;
-        is_recording_ = true;
+void AvocadoPlugin::commitSlice(Channel& ch) {
+    int record_buffer = rng_.nextInt(buffer_count_);
+    if (record_buffer == voices_.slot[0]) {
+        record_buffer = (record_buffer + 1) % buffer_count_;
     }
+    latest_slice_ = ch.write_csr - record_csr_;
+    slice_start_[record_buffer] = latest_slice_;
+    record_csr_ = 0;
 }
 
-signal_t AvocadoPlugin::playback(Channel& ch, const signal_t in) {
+void AvocadoPlugin::startSlice(Channel& ch, const int v) {
 
     /*
     playback:
       if buffer ended, choose either same buffer or a new buffer
-      play selected buffer
      */
-    if (playback_csr_ > buffer_size_) {
-        playback_csr_ = 0;
+    if (voices_.csr[v] > voices_.len[v]) {
+        voices_.csr[v] = 0;
 
-        if (rand() % 100 > repeat_prob_) {
-            playback_buffer_ = rand() % buffer_count_;
+        if (rng_.nextInt(100) > repeat_prob_) {
+            voices_.slot[v] = rng_.nextInt(buffer_count_);
 
         }
     }
 
-    // fade edges
-    float mult = 1;
+    // each slice plays at its own rate, up to spread_ semitones either
+    // way, and lasts as long as that takes to cover buffer_size_ samples.
+    uint64_t rate = PLAY_ONE;
+    if (spread_ > 0) {
+        const float bend = rng_.next() * (2.0 / 4294967296.0) - 1.0;
+        rate = exp2(bend * spread_ / 12.0) * PLAY_ONE;
+    }
+    int len = ((uint64_t) buffer_size_ << PLAY_FRAC_BITS) / rate;
+
+    // at unity a slice's age stays constant while it plays, and a slower
+    // one falls back by at most len - buffer_size_, so if it's still in
+    // the history now it is for the whole slice. if not, it's been
+    // overwritten; use the latest one instead. record() runs up to
+    // SEGMENT_LEN samples ahead of playback(), so allow for that.
+    const int slot = voices_.slot[v];
+    const uint32_t lag = len > buffer_size_ ? len - buffer_size_ : 0;
+    if (ch.write_csr - slice_start_[slot] + lag >= ch.history_len - SEGMENT_LEN) {
+        slice_start_[slot] = latest_slice_;
+    }
 
-    if (playback_csr_ < FADE_SAMPLES) {
-        mult = (float) playback_csr_ / (float) FADE_SAMPLES;
-    } else if (playback_csr_ > buffer_size_ - FADE_SAMPLES) {
-        mult = (float) (buffer_size_ - playback_csr_ - 1) / (float) FADE_SAMPLES;
+    // a slice still being recorded (the first, or after Time grows) plays
+    // at unity, so the voice can't overtake the record head.
+    if (ch.write_csr - slice_start_[slot] <= (uint32_t) buffer_size_) {
+        rate = PLAY_ONE;
+        len = buffer_size_;
     }
 
-    // calculate raw output
-    signal_t curr = mult * ch.buffer[playback_buffer_][playback_csr_];
+    // take a copy; record() may repoint the slot while this plays
+    voices_.play[v] = (uint64_t) slice_start_[slot] << PLAY_FRAC_BITS;
+    voices_.rate[v] = rate;
+    voices_.len[v] = len;
+    voices_.fade[v] = fmax(fmin(fade_ms_ * srate / 1000.0, len / 2), 1);
+}
+
+void AvocadoPlugin::playback(Channel& ch, signal_t* out, const int n) {
 
-    // move cursor
-    playback_csr_ += 1;
-    return curr;
+    /*
+    playback:
+      mix the voices' slices
+     */
+    memset(out, 0, n * sizeof (signal_t));
+
+    const float g = voice_gain_;
+
+    for (int v = 0; v < voice_count_; ++v) {
+        const int csr = voices_.csr[v];
+        voices_.csr[v] += n;
+        if (csr < 0) {
+            continue;
+        }
+
+        // unity is a straight copy
+        const uint64_t rate = voices_.rate[v];
+        if (rate == PLAY_ONE) {
+            ch.readBlock(voices_.play[v] >> PLAY_FRAC_BITS, grain_, n);
+        } else {
+            ch.readBlockLinear(voices_.play[v], rate, grain_, n);
+        }
+        voices_.play[v] += rate * n;
+
+        // fade edges
+        const int len = voices_.len[v];
+        const int fade = voices_.fade[v];
+        const float step = 1.0f / fade;
+        const int fade_in_end = fmin(fmax(fade - csr, 0), n);
+        const int fade_out_start = fmin(fmax(len - fade + 1 - csr, fade_in_end), n);
+        int i = 0;
+        for (; i < fade_in_end; ++i) {
+            out[i] += grain_[i] * ((csr + i) * step) * g;
+        }
+        for (; i < fade_out_start; ++i) {
+            out[i] += grain_[i] * g;
+        }
+        for (; i < n; ++i) {
+            out[i] += grain_[i] * ((len - csr - i - 1) * step) * g;
+        }
+    }
 }
 
-float AvocadoPlugin::gate(Channel& ch, const signal_t in) {
-    // rectify and leaky integrate
-    leaky_integrator = fmin(leaky_integrator * leakage + fabs(in) * (1.0 - leakage), 1.0);
-    return leaky_integrator < threshold_ ? 1.0 : 0.0;
+void AvocadoPlugin::gate(const signal_t* in, signal_t* out, const int n) {
+    // state in locals so it isn't reloaded after every store to out
+    signal_t leaky = leaky_integrator;
+    float gain = gain_;
+    for (int i = 0; i < n; ++i) {
+        // rectify and leaky integrate
+        leaky = fmin(leaky * leakage + fabs(in[i]) * (1.0 - leakage), 1.0);
+        float target_gain = leaky < threshold_ ? 1.0 : 0.0;
+        gain = gain * (1.0 - attack_) + target_gain * attack_;
+        out[i] = in[i] + wet_[i] * gain;
+    }
+    leaky_integrator = leaky;
+    gain_ = gain;
 }
 
-signal_t AvocadoPlugin::process(Channel& ch, const signal_t in) {
-    record(ch, in);
-    signal_t curr = playback(ch, in);
-    float target_gain = gate(ch, in);
-    gain_ = gain_ * (1.0 - attack_) + target_gain * attack_;
-    return in + curr * gain_;
+void AvocadoPlugin::process(Channel& ch, const signal_t* in, signal_t* out, const int n) {
+    // slices start and end at arbitrary points in the block. between those
+    // points record and playback are plain copies, so do them a stretch at
+    // a time and make the glitch decisions only at the boundaries.
+    for (int i = 0; i < n;) {
+        int len = fmin(n - i, fmax(buffer_size_ + 1 - record_csr_, 1));
+        for (int v = 0; v < voice_count_; ++v) {
+            const int csr = voices_.csr[v];
+            if (csr > voices_.len[v] || csr == 0) {
+                startSlice(ch, v);
+            }
+            const int left = voices_.csr[v] < 0 ? -voices_.csr[v] : voices_.len[v] + 1 - voices_.csr[v];
+            len = fmin(len, left);
+        }
+        record(ch, in + i, len);
+        playback(ch, wet_ + i, len);
+        i += len;
+    }
+    gate(in, out, n);
 }
 
 // Per-channel processing.
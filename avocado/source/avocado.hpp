@@ -27,9 +27,14 @@
 #include "math.h"
 
 
-const int MAX_BUFLEN = 48000 * 4.0; // 4 sec
-const int MAX_BUFFERS = 8;
-const int FADE_SAMPLES = 128;
+const float MAX_BUF_MS = 250; // longest Time setting
+const int MAX_BUFFERS = 16; // highest Slices setting
+const int SEGMENT_LEN = 256; // longest run copied between glitch decisions
+const int MAX_VOICES = 32;
+const float MAX_SPREAD = 12; // semitones either side of unity
+const float MAX_FADE_MS = 25;
+const int PLAY_FRAC_BITS = 32; // voice read positions are fixed point
+const uint64_t PLAY_ONE = (uint64_t) 1 << PLAY_FRAC_BITS;
 
 const int NUM_PROGRAMS = 1;
 
@@ -38,6 +43,11 @@ public:
 
     enum Parameters {
         PARAM_BUF_LENGTH,
+        PARAM_SEED,
+        PARAM_VOICES,
+        PARAM_SLICES,
+        PARAM_SPREAD,
+        PARAM_FADE,
         PARAM_COUNT
     };
 
@@ -45,13 +55,88 @@ public:
     public:
 
         Channel() {
-            memset(buffer, 0, MAX_BUFFERS * MAX_BUFLEN * sizeof (signal_t));
         }
-        signal_t buffer[MAX_BUFFERS][MAX_BUFLEN] = {};
+
+        Channel(const Channel&) = delete;
+        Channel& operator=(const Channel&) = delete;
+
+        ~Channel() {
+            delete[] history;
+        }
+
+        // (Re)allocates the history ring to hold at least len samples,
+        // cleared. Not realtime safe; call from activate().
+
+        void allocate(const int len) {
+            uint32_t size = 1;
+            while (size < (uint32_t) len) {
+                size <<= 1;
+            }
+            if (size != history_len) {
+                delete[] history;
+                history = new TapeSample::stored_t[size];
+            }
+            history_len = size;
+            history_mask = size - 1;
+            memset(history, 0, size * sizeof (TapeSample::stored_t));
+            write_csr = 0;
+        }
+
+        void write(const signal_t in) {
+            history[write_csr & history_mask] = TapeSample::pack(in);
+            write_csr += 1;
+        }
+
+        // Sample at absolute position pos, which must be less than
+        // history_len samples old.
+
+        signal_t read(const uint32_t pos) const {
+            return TapeSample::unpack(history[pos & history_mask]);
+        }
+
+        // Block versions of write() and read(); n must not exceed
+        // history_len. Each is at most two runs either side of the wrap.
+
+        void writeBlock(const signal_t* in, const int n) {
+            const uint32_t at = write_csr & history_mask;
+            const uint32_t first = history_len - at < (uint32_t) n ? history_len - at : n;
+            TapeSample::packBlock(in, history + at, first);
+            TapeSample::packBlock(in + first, history, n - first);
+            write_csr += n;
+        }
+
+        void readBlock(const uint32_t pos, signal_t* out, const int n) const {
+            const uint32_t at = pos & history_mask;
+            const uint32_t first = history_len - at < (uint32_t) n ? history_len - at : n;
+            TapeSample::unpackBlock(history + at, out, first);
+            TapeSample::unpackBlock(history, out + first, n - first);
+        }
+
+        // Like readBlock(), but from fixed point position pos moving step
+        // per sample, interpolated linearly. Reads one sample past the
+        // last position.
+
+        void readBlockLinear(uint64_t pos, const uint64_t step, signal_t* out, const int n) const {
+            for (int i = 0; i < n; ++i) {
+                const uint32_t at = pos >> PLAY_FRAC_BITS;
+                const float frac = (pos & (PLAY_ONE - 1)) * (1.0f / PLAY_ONE);
+                const signal_t a = read(at);
+                out[i] = a + frac * (read(at + 1) - a);
+                pos += step;
+            }
+        }
 
         void tick() {
             //
         }
+
+        // input history, stored as TapeSample. write_csr is the absolute
+        // # samples written and wraps; positions are compared by unsigned
+        // difference.
+        TapeSample::stored_t* history = nullptr;
+        uint32_t history_len = 0;
+        uint32_t history_mask = 0;
+        uint32_t write_csr = 0;
     };
 
     /**
@@ -148,32 +233,78 @@ protected:
      */
     void setParameterValue(uint32_t index, float value) override;
 
+    // -------------------------------------------------------------------
+    // Process
+
+    /**
+      Allocates the sample buffers for the current sample rate.
+     */
+    void activate() override;
+
     /**
       Run/process function for plugins without MIDI input.
      */
     void run(const float** inputs, float** outputs, uint32_t frames) override;
 
+    // -------------------------------------------------------------------
+    // Callbacks
+
+    /**
+      Rescales the slice length for the new rate. Hosts only change it
+      while deactivated, so activate() sizes the history to match.
+     */
+    void sampleRateChanged(double newSampleRate) override;
+
 private:
-    signal_t process(Channel& ch, const signal_t in);
-    void record(Channel& ch, const signal_t in);
-    signal_t playback(Channel& ch, const signal_t in);
-    float gate(Channel& ch, const signal_t in);
+    void fixBufferSize();
+    void process(Channel& ch, const signal_t* in, signal_t* out, const int n);
+    void record(Channel& ch, const signal_t* in, const int n);
+    void playback(Channel& ch, signal_t* out, const int n);
+    void commitSlice(Channel& ch);
+    void startSlice(Channel& ch, const int v);
+    void staggerVoices(const int first);
+    void gate(const signal_t* in, signal_t* out, const int n);
 
     Channel left_;
 
     // params
 
     // glitcher
+    // each "buffer" is a slice of the channel history, kept as its start.
     int buffer_count_ = 5;
+    float buffer_ms_ = 50; // the Time param; buffer_size_ follows the rate
     int buffer_size_ = 2048;
+    uint32_t slice_start_[MAX_BUFFERS] = {};
+    uint32_t latest_slice_ = 0;
     int record_csr_ = 0;
-    int record_buffer_ = 0;
-    int playback_buffer_ = 0;
-    int playback_csr_ = 0;
-    bool is_recording_ = false;
+
+    // playback voices, structure-of-arrays. each plays one slice at a time:
+    // slot is the buffer it's on, play its read position in the history
+    // and rate how far that moves per sample, both fixed point. len is the
+    // slice's last sample at that rate, fade the length of its edges, and
+    // csr how far into it the voice is. a negative csr counts down to the
+    // voice's first slice.
+    struct Voices {
+        int slot[MAX_VOICES] = {};
+        uint64_t play[MAX_VOICES] = {};
+        uint64_t rate[MAX_VOICES] = {};
+        int len[MAX_VOICES] = {};
+        int fade[MAX_VOICES] = {};
+        int csr[MAX_VOICES] = {};
+    };
+
+    Voices voices_;
+    int voice_count_ = 1;
+    float voice_gain_ = 1;
+
+    // glitch decisions. reseeded on activate() so renders are repeatable.
+    Prng rng_;
+    int seed_ = 0;
 
     // params
     SmoothParam<float> repeat_prob_ = 50;
+    float spread_ = 0;
+    float fade_ms_ = 2.5;
 
     // gate
     signal_t leaky_integrator = 0;
@@ -185,6 +316,11 @@ private:
     //
     samples_t srate;
 
+    // playback for the current block, before gating, and one voice's
+    // share of it
+    signal_t wet_[SEGMENT_LEN];
+    signal_t grain_[SEGMENT_LEN];
+
     void tick() {
         left_.tick();
     }
@@ -0,0 +1,308 @@
+/*
+    Benchmark Code:
+    Copyright 2016 Daniel Arena <dan@remaincalm.org>
+    LGPL3
+ */
+
+/*
+Offline render benchmark.
+
+Drives a plugin's run() directly with no host, over a range of sample rates,
+block sizes and every program from loadProgram(), and reports:
+
+ * ns/sample   - mean processing time per sample
+ * %rt         - fraction of the realtime budget used (100% = one core flat out)
+ * worst       - slowest single block, in us and as % of that block's budget
+
+It also reports, per sample rate, what one instance costs to bring up:
+construct and activate() times, sizeof the plugin class and how much
+resident memory (RSS, Linux only) an activated instance adds.
+
+The Makefile builds this once per plugin, against that plugin's own source
+dir, util.hpp and DistrhoPluginInfo.h, so the plugin headers never collide.
+
+Usage: bench-<plugin> [-t seconds] [-b blocksize] [-r samplerate] [-p index=value]...
+                      [-s index=value,value...]
+
+ -p fixes a parameter after each program is loaded, e.g. to pin a mode.
+ -s repeats every run for each of the given values of a parameter, to
+    compare what each setting costs (e.g. floaty's interpolation, -s 6=0,1,2,3).
+
+ */
+
+#include "DistrhoPluginInternal.hpp"
+#include BENCH_PLUGIN_HEADER
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <unistd.h>
+
+START_NAMESPACE_DISTRHO
+extern double d_lastSampleRate;
+extern uint32_t d_lastBufferSize;
+END_NAMESPACE_DISTRHO
+
+typedef std::chrono::steady_clock bench_clock;
+
+// Exposes the protected DPF callbacks so we can act as the host.
+
+class BenchPlugin : public BENCH_PLUGIN_CLASS {
+public:
+    using BENCH_PLUGIN_CLASS::activate;
+    using BENCH_PLUGIN_CLASS::initProgramName;
+    using BENCH_PLUGIN_CLASS::loadProgram;
+    using BENCH_PLUGIN_CLASS::setParameterValue;
+
+    void render(const float** inputs, float** outputs, uint32_t frames) {
+#if DISTRHO_PLUGIN_WANT_MIDI_INPUT
+        run(inputs, outputs, frames, nullptr, 0);
+#else
+        run(inputs, outputs, frames);
+#endif
+    }
+};
+
+struct ParamOverride {
+    uint32_t index;
+    float value;
+};
+
+struct Footprint {
+    double construct_us = 0;
+    double activate_us = 0;
+    long resident_kib = 0;
+};
+
+struct Result {
+    double ns_per_sample = 0;
+    double rt_percent = 0;
+    double worst_us = 0;
+    double worst_percent = 0;
+};
+
+// Synthetic guitar-ish input: plucked notes w/ decaying harmonics, a bit of
+// pick noise, retriggered every 400ms and cycling through a few pitches.
+
+static std::vector<float> makeInput(double srate, int len) {
+    static const float notes_hz[] = {82.4, 110.0, 146.8, 196.0, 246.9, 329.6};
+    const int note_len = (int) (0.4 * srate);
+
+    std::vector<float> out(len);
+    unsigned noise = 12345;
+    for (int i = 0; i < len; ++i) {
+        const int note = (i / note_len) % 6;
+        const double t = (i % note_len) / srate;
+        const double f = notes_hz[note];
+        const double env = exp(-4.0 * t);
+
+        double s = 0;
+        for (int h = 1; h <= 6; ++h) {
+            s += sin(2.0 * PI * f * h * t) / (h * h);
+        }
+        noise = noise * 1664525u + 1013904223u;
+        const double pick = (t < 0.01) ? ((noise >> 9) / 4194304.0 - 1.0) * 0.2 : 0;
+        out[i] = 0.5 * env * s + pick;
+    }
+    return out;
+}
+
+// Resident set size of this process, in KiB. 0 where /proc isn't available.
+
+static long residentKiB() {
+    FILE* f = fopen("/proc/self/statm", "r");
+    if (f == nullptr) {
+        return 0;
+    }
+    long size = 0;
+    long resident = 0;
+    if (fscanf(f, "%ld %ld", &size, &resident) != 2) {
+        resident = 0;
+    }
+    fclose(f);
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+// Brings up one instance and returns it; the caller deletes it, once done
+// measuring, so freed pages don't get reused and hide the next one's RSS.
+
+static Footprint measureInstance(double srate, uint32_t block, BenchPlugin** instance) {
+    d_lastSampleRate = srate;
+    d_lastBufferSize = block;
+
+    const long resident_before = residentKiB();
+    const bench_clock::time_point start = bench_clock::now();
+    BenchPlugin* plugin = new BenchPlugin();
+    const bench_clock::time_point constructed = bench_clock::now();
+    plugin->activate();
+    const bench_clock::time_point activated = bench_clock::now();
+    const long resident_after = residentKiB();
+    *instance = plugin;
+
+    Footprint f;
+    f.construct_us = std::chrono::duration<double, std::micro>(constructed - start).count();
+    f.activate_us = std::chrono::duration<double, std::micro>(activated - constructed).count();
+    f.resident_kib = resident_after - resident_before;
+    return f;
+}
+
+static Result benchOne(double srate, uint32_t block, uint32_t program,
+        const std::vector<ParamOverride>& overrides, double seconds) {
+    d_lastSampleRate = srate;
+    d_lastBufferSize = block;
+
+    BenchPlugin* plugin = new BenchPlugin();
+    plugin->loadProgram(program);
+    for (const ParamOverride& p : overrides) {
+        plugin->setParameterValue(p.index, p.value);
+    }
+    plugin->activate();
+
+    const int input_len = (int) (2.0 * srate);
+    const std::vector<float> input = makeInput(srate, input_len + block);
+    std::vector<float> scratch(DISTRHO_PLUGIN_NUM_OUTPUTS * block);
+    float* outputs[DISTRHO_PLUGIN_NUM_OUTPUTS];
+    for (int c = 0; c < DISTRHO_PLUGIN_NUM_OUTPUTS; ++c) {
+        outputs[c] = &scratch[c * block];
+    }
+
+    // warm up caches and let smoothed params settle.
+    const long warmup = (long) (0.1 * srate);
+    long pos = 0;
+    for (long done = 0; done < warmup; done += block) {
+        const float* inputs[DISTRHO_PLUGIN_NUM_INPUTS];
+        for (int c = 0; c < DISTRHO_PLUGIN_NUM_INPUTS; ++c) {
+            inputs[c] = &input[pos];
+        }
+        plugin->render(inputs, outputs, block);
+        pos = (pos + block) % input_len;
+    }
+
+    const long total = (long) (seconds * srate) / block * block;
+    double elapsed_ns = 0;
+    double worst_ns = 0;
+    for (long done = 0; done < total; done += block) {
+        const float* inputs[DISTRHO_PLUGIN_NUM_INPUTS];
+        for (int c = 0; c < DISTRHO_PLUGIN_NUM_INPUTS; ++c) {
+            inputs[c] = &input[pos];
+        }
+        const bench_clock::time_point start = bench_clock::now();
+        plugin->render(inputs, outputs, block);
+        const bench_clock::time_point end = bench_clock::now();
+
+        const double ns = std::chrono::duration<double, std::nano>(end - start).count();
+        elapsed_ns += ns;
+        worst_ns = fmax(worst_ns, ns);
+        pos = (pos + block) % input_len;
+    }
+
+    delete plugin;
+
+    const double block_budget_ns = 1e9 * block / srate;
+    Result r;
+    r.ns_per_sample = elapsed_ns / total;
+    r.rt_percent = 100.0 * r.ns_per_sample * srate / 1e9;
+    r.worst_us = worst_ns / 1000.0;
+    r.worst_percent = 100.0 * worst_ns / block_budget_ns;
+    return r;
+}
+
+int main(int argc, char** argv) {
+    std::vector<double> srates = {44100, 48000, 96000};
+    std::vector<uint32_t> blocks = {1, 16, 64, 128, 256, 512, 1024, 4096};
+    std::vector<ParamOverride> overrides;
+    std::vector<ParamOverride> sweep;
+    double seconds = 2.0;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+            seconds = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "-b") && i + 1 < argc) {
+            blocks = {(uint32_t) atoi(argv[++i])};
+        } else if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+            srates = {atof(argv[++i])};
+        } else if (!strcmp(argv[i], "-p") && i + 1 < argc) {
+            ParamOverride p;
+            if (sscanf(argv[++i], "%u=%f", &p.index, &p.value) != 2) {
+                fprintf(stderr, "bad -p '%s', want index=value\n", argv[i]);
+                return 1;
+            }
+            overrides.push_back(p);
+        } else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+            ParamOverride p;
+            int used = 0;
+            const char* arg = argv[++i];
+            if (sscanf(arg, "%u=%f%n", &p.index, &p.value, &used) != 2) {
+                fprintf(stderr, "bad -s '%s', want index=value,value...\n", arg);
+                return 1;
+            }
+            sweep.push_back(p);
+            for (arg += used; *arg == ','; arg += used) {
+                if (sscanf(arg, ",%f%n", &p.value, &used) != 1) {
+                    fprintf(stderr, "bad -s '%s', want index=value,value...\n", argv[i]);
+                    return 1;
+                }
+                sweep.push_back(p);
+            }
+        } else {
+            fprintf(stderr, "usage: %s [-t seconds] [-b blocksize] [-r samplerate] [-p index=value]... [-s index=value,value...]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    printf("%-10s %6s %12s %12s %12s %12s\n",
+            "plugin", "srate", "construct us", "activate us", "sizeof KiB", "rss KiB");
+    std::vector<BenchPlugin*> instances(srates.size() + 1);
+    measureInstance(srates[0], blocks[0], &instances[0]); // first one pays for page faults in code/libs.
+    for (size_t i = 0; i < srates.size(); ++i) {
+        const double srate = srates[i];
+        const Footprint f = measureInstance(srate, blocks[0], &instances[i + 1]);
+        printf("%-10s %6.0f %12.1f %12.1f %12.1f %12ld\n",
+                DISTRHO_PLUGIN_NAME, srate, f.construct_us, f.activate_us,
+                sizeof (BenchPlugin) / 1024.0, f.resident_kib);
+    }
+    for (BenchPlugin* p : instances) {
+        delete p;
+    }
+    printf("\n");
+
+    if (sweep.empty()) {
+        // one pass with just the fixed overrides.
+        sweep.push_back(ParamOverride{(uint32_t) BenchPlugin::PARAM_COUNT, 0});
+    }
+
+    printf("%-10s %-16s %-8s %6s %6s %10s %8s %10s %8s\n",
+            "plugin", "program", "setting", "srate", "block", "ns/sample", "%rt", "worst us", "worst %");
+
+    for (uint32_t program = 0; program < (uint32_t) NUM_PROGRAMS; ++program) {
+        // programs are named via the plugin itself, so we need an instance.
+        d_lastSampleRate = srates[0];
+        d_lastBufferSize = blocks[0];
+        BenchPlugin* namer = new BenchPlugin();
+        String name;
+        namer->initProgramName(program, name);
+        delete namer;
+
+        for (const ParamOverride& setting : sweep) {
+            std::vector<ParamOverride> params = overrides;
+            char label[32] = "-";
+            if (setting.index < (uint32_t) BenchPlugin::PARAM_COUNT) {
+                params.push_back(setting);
+                snprintf(label, sizeof (label), "%u=%g", setting.index, setting.value);
+            }
+            for (double srate : srates) {
+                for (uint32_t block : blocks) {
+                    const Result r = benchOne(srate, block, program, params, seconds);
+                    printf("%-10s %-16s %-8s %6.0f %6u %10.2f %8.3f %10.2f %8.2f\n",
+                            DISTRHO_PLUGIN_NAME, name.buffer(), label, srate, block,
+                            r.ns_per_sample, r.rt_percent, r.worst_us, r.worst_percent);
+                    fflush(stdout);
+                }
+            }
+        }
+    }
+
+    return 0;
+}
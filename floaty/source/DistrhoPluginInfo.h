@@ -22,12 +22,22 @@
 #ifndef DISTRHO_PLUGIN_INFO_H_INCLUDED
 #define DISTRHO_PLUGIN_INFO_H_INCLUDED
 
+#ifdef FLOATY_STEREO
+#define DISTRHO_PLUGIN_NAME "floaty stereo"
+#define DISTRHO_PLUGIN_URI  "http://remaincalm.org/plugins/floaty-stereo"
+#define DISTRHO_PLUGIN_NUM_INPUTS    2
+#define DISTRHO_PLUGIN_NUM_OUTPUTS   2
+#else
 #define DISTRHO_PLUGIN_NAME "floaty"
 #define DISTRHO_PLUGIN_URI  "http://remaincalm.org/plugins/floaty"
-
-#define DISTRHO_PLUGIN_IS_RT_SAFE    1
 #define DISTRHO_PLUGIN_NUM_INPUTS    1
 #define DISTRHO_PLUGIN_NUM_OUTPUTS   1
+#endif
+
+#define DISTRHO_PLUGIN_IS_RT_SAFE    1
+#ifdef HALF_RATE
+#define DISTRHO_PLUGIN_WANT_LATENCY  1
+#endif
 #define DISTRHO_PLUGIN_WANT_PROGRAMS 1
 #define DISTRHO_PLUGIN_USES_MODGUI   1
 
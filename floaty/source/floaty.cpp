@@ -43,6 +43,7 @@ So, it's good fun.
 #include "DistrhoPlugin.hpp"
 #include "floaty.hpp"
 #include "math.h"
+#include "stdio.h"
 #include "util.hpp"
 
 void FloatyPlugin::initProgramName(uint32_t index, String& programName) {
@@ -92,6 +93,8 @@ void FloatyPlugin::loadProgram(uint32_t index) {
         playback_rate_.complete();
 
         setParameterValue(PARAM_DELAY_MS, params[index][0]);
+        // a preset jumps to its delay rather than gliding there.
+        resetHeads();
     }
 }
 
@@ -156,9 +159,64 @@ void FloatyPlugin::initParameter(uint32_t index, Parameter& parameter) {
             parameter.ranges.max = 2;
             break;
 
+        case PARAM_INTERPOLATION:
+            parameter.hints = kParameterIsAutomable | kParameterIsInteger;
+            parameter.name = "Interpolation";
+            parameter.symbol = "interp";
+            parameter.unit = "";
+            parameter.ranges.def = INTERP_LINEAR;
+            parameter.ranges.min = INTERP_LINEAR;
+            parameter.ranges.max = INTERP_COUNT - 1;
+            break;
+
+        case PARAM_TAPS:
+            parameter.hints = kParameterIsAutomable | kParameterIsInteger;
+            parameter.name = "Taps";
+            parameter.symbol = "taps";
+            parameter.unit = "";
+            parameter.ranges.def = 1;
+            parameter.ranges.min = 1;
+            parameter.ranges.max = MAX_HEADS;
+            break;
+
+        default:
+            initHeadParameter(index, parameter);
+            break;
     }
 }
 
+// The per-head params, numbered from 1 for the host.
+
+void FloatyPlugin::initHeadParameter(uint32_t index, Parameter& parameter) {
+    const int k = (index - PARAM_HEAD_RATE) % MAX_HEADS;
+    char name[32];
+    char symbol[32];
+    if (index < PARAM_HEAD_LEVEL) {
+        snprintf(name, sizeof (name), "Head %d Rate", k + 1);
+        snprintf(symbol, sizeof (symbol), "head%d_rate", k + 1);
+        parameter.unit = "x";
+        parameter.ranges.def = 1;
+        parameter.ranges.min = -2;
+        parameter.ranges.max = 2;
+    } else if (index < PARAM_HEAD_LEVEL + MAX_HEADS) {
+        snprintf(name, sizeof (name), "Head %d Level", k + 1);
+        snprintf(symbol, sizeof (symbol), "head%d_level", k + 1);
+        parameter.unit = "%";
+        parameter.ranges.def = 100;
+        parameter.ranges.min = 0;
+        parameter.ranges.max = 100;
+    } else {
+        snprintf(name, sizeof (name), "Head %d Pan", k + 1);
+        snprintf(symbol, sizeof (symbol), "head%d_pan", k + 1);
+        parameter.unit = "%";
+        parameter.ranges.def = 0;
+        parameter.ranges.min = -100;
+        parameter.ranges.max = 100;
+    }
+    parameter.name = name;
+    parameter.symbol = symbol;
+}
+
 // -------------------------------------------------------------------
 // Internal data
 
@@ -180,8 +238,24 @@ float FloatyPlugin::getParameterValue(uint32_t index) const {
             return filter_;
         case PARAM_PLAYBACK_RATE:
             return playback_rate_;
+        case PARAM_INTERPOLATION:
+            return interpolation_;
+        case PARAM_TAPS:
+            return heads_;
         default:
-            return 0;
+            break;
+    }
+
+    if (index < PARAM_HEAD_RATE || index >= PARAM_COUNT) {
+        return 0;
+    }
+    const int k = (index - PARAM_HEAD_RATE) % MAX_HEADS;
+    if (index < PARAM_HEAD_LEVEL) {
+        return head_rate_[k];
+    } else if (index < PARAM_HEAD_LEVEL + MAX_HEADS) {
+        return 100.0 * head_trim_[k];
+    } else {
+        return 100.0 * head_pan_[k];
     }
 }
 
@@ -213,7 +287,9 @@ void FloatyPlugin::setParameterValue(uint32_t index, float value) {
             } else {
                 warp_rate_hz_ = 3.5;
             }
-            warp_rate_rad_ = 2.0 * PI * warp_rate_hz_ / (float) srate;
+            for (int k = 0; k < MAX_HEADS; ++k) {
+                warp_lfo_[k].setRate(2.0 * PI * warp_rate_hz_ * CONTROL_LEN / (float) srate);
+            }
             warp_amount_ = 0.012 * fabs(2.0 - 0.04 * value);
             break;
 
@@ -231,101 +307,623 @@ void FloatyPlugin::setParameterValue(uint32_t index, float value) {
             }
             playback_rate_ = value;
             break;
+
+        case PARAM_INTERPOLATION:
+            interpolation_ = fmin(fmax(value, 0), INTERP_COUNT - 1);
+            break;
+
+        case PARAM_TAPS:
+            heads_ = fmin(fmax(value, 1), MAX_HEADS);
+            fixHeadParams();
+            resetHeads();
+            break;
+
+        default:
+            setHeadParameterValue(index, value);
+            break;
     }
 }
 
-void FloatyPlugin::fixDelayParams() {
+// A head's rate takes effect on its next step, like the tape speeding up
+// under it; level and pan go into the head gains.
+
+void FloatyPlugin::setHeadParameterValue(uint32_t index, float value) {
+    if (index < PARAM_HEAD_RATE || index >= PARAM_COUNT) {
+        return;
+    }
+    const int k = (index - PARAM_HEAD_RATE) % MAX_HEADS;
+    if (index < PARAM_HEAD_LEVEL) {
+        head_rate_[k] = fmin(fmax(value, -2), 2);
+    } else if (index < PARAM_HEAD_LEVEL + MAX_HEADS) {
+        head_trim_[k] = 0.01 * fmin(fmax(value, 0), 100);
+        fixHeadParams();
+    } else {
+        head_pan_[k] = 0.01 * fmin(fmax(value, -100), 100);
+        fixHeadParams();
+    }
+}
+
+// Right channel, if any, runs a little longer, up to the longest delay the
+// tape loop holds. Near the top of the Delay knob the offset shrinks to
+// nothing rather than the loop cap making the right channel the shorter.
+
+samples_t FloatyPlugin::channelDelay(const int c) const {
     samples_frac_t lr_offset = (1.0 - 0.01 * channel_offset_) * delay_;
-    left_.setDelay(delay_);
-    right_.setDelay(delay_ + lr_offset);
-    warp_counter_ = 0;
+    return fmin(MAX_BUF / 2, delay_ + c * lr_offset);
+}
+
+// Glides each channel to the new delay.
+
+void FloatyPlugin::fixDelayParams() {
+    for (int c = 0; c < NUM_CHANNELS; ++c) {
+        channels_[c].setDelay(channelDelay(c));
+    }
+}
+
+// Puts the heads straight at the delay, for a new layout.
+
+void FloatyPlugin::resetHeads() {
+    for (int c = 0; c < NUM_CHANNELS; ++c) {
+        channels_[c].reset(channelDelay(c), heads_);
+    }
+    // heads drift out of step with each other.
+    for (int k = 0; k < MAX_HEADS; ++k) {
+        warp_lfo_[k].reset(2.0 * PI * k / heads_);
+    }
     playback_rate_.complete();
 }
 
-void FloatyPlugin::fixFilterParams() {
-    float filter_res_ = 0.25 + filter_ * 0.5;
-    float filter_cutoff_ = 45.0 + 40.0 * cos(filter_ / 12.0);
-    filter_gain_ = 2.2 - 1.2 * cos(filter_ / 12.0);
+// Each head is quieter than the one before, and in the stereo build they
+// fan out from the left, longest first. Levels sum to one so the feedback
+// loop gain doesn't depend on the number of heads. Each head's Level and
+// Pan then trim its place in that layout.
 
-    float lc = powf(0.5, 4.6 - (filter_cutoff_ / 27.2));
-    lpf_.c = lc;
-    float lr = powf(0.5, -0.6 + filter_res_ / 40.0);
-    lpf_.one_minus_rc = 1.0 - (lr * lc);
+void FloatyPlugin::fixHeadParams() {
+    float sum = 0;
+    for (int k = 0; k < heads_; ++k) {
+        head_level_[k] = powf(HEAD_DECAY, k);
+        sum += head_level_[k];
+    }
+    for (int k = 0; k < heads_; ++k) {
+        head_level_[k] /= sum;
+        head_level_[k] *= head_trim_[k];
+        const float spread = (heads_ > 1) ? HEAD_SPREAD * (2.0 * k / (heads_ - 1) - 1.0) : 0;
+        const float pan = fmin(1.0, fmax(-1.0, spread + head_pan_[k]));
+        for (int c = 0; c < NUM_CHANNELS; ++c) {
+            const float side = (NUM_CHANNELS > 1) ? 2.0 * c / (NUM_CHANNELS - 1) - 1.0 : 0;
+            head_gain_[c][k] = head_level_[k] * fmin(1.0, 1.0 + side * pan);
+        }
+    }
+}
 
-    float hc = powf(0.5, 4.1 + (filter_cutoff_ / 200.0));
-    hpf_.c = hc;
-    float hr = powf(0.5, 1 + filter_res_ / 200.0);
-    hpf_.one_minus_rc = 1.0 - (hr * hc);
+namespace {
+
+    // The Filter knob's mapping, tabulated. Shared by all instances; built
+    // by the first one constructed.
+
+    FilterTable<> filter_table;
+
+    FilterCoeffs filterCoeffs(const float filter) {
+        const float filter_res = 0.25 + filter * 0.5;
+        const float filter_cutoff = 45.0 + 40.0 * cos(filter / 12.0);
+
+        FilterCoeffs out;
+        out.gain = 2.2 - 1.2 * cos(filter / 12.0);
+
+        out.lc = wetRateCoeff(powf(0.5, 4.6 - (filter_cutoff / 27.2)));
+        const float lr = powf(0.5, -0.6 + filter_res / 40.0);
+        out.l_one_minus_rc = 1.0 - (lr * out.lc);
+
+        out.hc = wetRateCoeff(powf(0.5, 4.1 + (filter_cutoff / 200.0)));
+        const float hr = powf(0.5, 1 + filter_res / 200.0);
+        out.h_one_minus_rc = 1.0 - (hr * out.hc);
+        return out;
+    }
+
+    bool buildFilterTable() {
+        filter_table.build(filterCoeffs);
+        return true;
+    }
+}
+
+void FloatyPlugin::initFilterTable() {
+    static const bool built = buildFilterTable();
+    (void) built;
+}
+
+void FloatyPlugin::fixFilterParams() {
+    const FilterCoeffs coeffs = filter_table.lookup(filter_);
+    filter_gain_ = coeffs.gain;
+    filters_.set(coeffs);
 }
 
 /**
   Run/process function for plugins without MIDI input.
  */
 void FloatyPlugin::run(const float** inputs, float** outputs, uint32_t frames) {
-    // TODO(dca): right channel.
-    const float* const input = inputs[0];
-    /* */ float* const left_output = outputs[0];
+    const int CHUNK_LEN = RATE_DIV * BLOCK_LEN;
+    for (uint32_t i = 0; i < frames;) {
+        const int n = fmin(frames - i, CHUNK_LEN);
+        const float* in[NUM_CHANNELS];
+        float* out[NUM_CHANNELS];
+        float wet_buf[NUM_CHANNELS][CHUNK_LEN];
+        const float* wet[NUM_CHANNELS];
+        for (int c = 0; c < NUM_CHANNELS; ++c) {
+            in[c] = inputs[c] + i;
+            out[c] = outputs[c] + i;
+            wet[c] = wet_buf[c];
+        }
+
+#ifdef HALF_RATE
+        // down to the wet path's rate and back up, with the dry signal
+        // delayed to match.
+        float half_in_buf[NUM_CHANNELS][BLOCK_LEN];
+        float half_out_buf[NUM_CHANNELS][BLOCK_LEN];
+        float dry_buf[NUM_CHANNELS][CHUNK_LEN];
+        const float* half_in[NUM_CHANNELS];
+        float* half_out[NUM_CHANNELS];
+        const float* dry[NUM_CHANNELS];
+        int m = 0;
+        for (int c = 0; c < NUM_CHANNELS; ++c) {
+            m = channels_[c].decimator.process(in[c], half_in_buf[c], n);
+            half_in[c] = half_in_buf[c];
+            half_out[c] = half_out_buf[c];
+        }
+        processWet(half_in, half_out, m);
+        for (int c = 0; c < NUM_CHANNELS; ++c) {
+            Channel& ch = channels_[c];
+            ch.interpolator.process(half_out_buf[c], wet_buf[c], n);
+            for (int k = 0; k < n; ++k) {
+                ch.dry.write(in[c][k]);
+                dry_buf[c][k] = ch.dry.read(HALFBAND_LATENCY + 1);
+            }
+            dry[c] = dry_buf[c];
+        }
+        mix(dry, wet, out, n);
+#else
+        float* wet_out[NUM_CHANNELS];
+        for (int c = 0; c < NUM_CHANNELS; ++c) {
+            wet_out[c] = wet_buf[c];
+        }
+        processWet(in, wet_out, n);
+        mix(in, wet, out, n);
+#endif
+        i += n;
+    }
+}
 
-    for (uint32_t i = 0; i < frames; ++i) {
-        tick();
-        left_output[i] = process(left_, input[i]);
+// Runs the wet path over n samples at its own rate: all of Floaty but the
+// mix.
+
+void FloatyPlugin::processWet(const float** in, float** out, const int n) {
+    for (int i = 0; i < n;) {
+        if (control_.due()) {
+            fixWarp();
+        }
+        const int end = i + control_.span(n - i);
+        if (isSettled()) {
+            while (i < end) {
+                const float* in_i[NUM_CHANNELS];
+                float* out_i[NUM_CHANNELS];
+                for (int c = 0; c < NUM_CHANNELS; ++c) {
+                    in_i[c] = in[c] + i;
+                    out_i[c] = out[c] + i;
+                }
+                const int done = processBlock(in_i, out_i, end - i);
+                control_.advance(done);
+                i += done;
+            }
+        } else {
+            for (; i < end; ++i) {
+                tick();
+                for (int k = 0; k < heads_; ++k) {
+                    warp_mod_[k] += warp_step_[k];
+                }
+                for (int c = 0; c < NUM_CHANNELS; ++c) {
+                    channels_[c].glide();
+                    out[c][i] = process(channels_[c], c, in[c][i], warp_mod_);
+                }
+                control_.advance(1);
+            }
+        }
     }
 }
 
-signal_t FloatyPlugin::process(Channel& ch, const signal_t in) {
-    // Read back from tape.
-    advancePlayHead(ch);
-    signal_t curr = readFromPlayHead(ch);
-    curr = fadeNearOverlap(ch, curr);
-    curr = saturate(curr);
-    curr = filter_gain_ * bandpassFilter(ch, curr);
+// Control-rate warp: steps each head's LFO and sets its warp to ramp to
+// the new value over the next control period.
+
+void FloatyPlugin::fixWarp() {
+    warp_amount_.tickBlock(CONTROL_LEN);
+
+    // clamp warp_amount_ to prevent overruns.
+    // magic number chosen experimentally.
+    float max_warp_amount = ((channel_offset_ * delay_ / 100.0) - SMOOTH_OVERLAP) * warp_rate_hz_ / 16000.0;
+    const float depth = fmin(max_warp_amount, warp_amount_);
+    for (int k = 0; k < heads_; ++k) {
+        warp_step_[k] = (depth * warp_lfo_[k].next() - warp_mod_[k]) / CONTROL_LEN;
+    }
+}
+
+// Mixes n samples of the wet path's output into the dry signal.
+
+void FloatyPlugin::mix(const float** dry, const float** wet, float** out, const int n) {
+    if (mix_.isSettled()) {
+        for (int c = 0; c < NUM_CHANNELS; ++c) {
+            if (mix_ < 0.5) {
+                // dry full vol, fade in wet
+                const float gain = 2.0 * mix_;
+                for (int i = 0; i < n; ++i) {
+                    out[c][i] = dry[c][i] + gain * wet[c][i];
+                }
+            } else {
+                // wet full vol, fade out dry
+                const float gain = 2.0 * (1.0 - mix_);
+                for (int i = 0; i < n; ++i) {
+                    out[c][i] = wet[c][i] + gain * dry[c][i];
+                }
+            }
+        }
+    } else {
+        for (int i = 0; i < n; ++i) {
+            mix_.tick();
+            for (int c = 0; c < NUM_CHANNELS; ++c) {
+                if (mix_ < 0.5) {
+                    out[c][i] = dry[c][i] + 2.0 * mix_ * wet[c][i];
+                } else {
+                    out[c][i] = wet[c][i] + 2.0 * (1.0 - mix_) * dry[c][i];
+                }
+            }
+        }
+    }
+}
+
+// Processes a sample on channel c, with warp holding each head's warp.
+// Returns the wet signal.
+
+signal_t FloatyPlugin::process(Channel& ch, const int c, const signal_t in, const float* warp) {
+    // Read back from tape, summing the heads.
+    signal_t fb = 0;
+    signal_t wet = 0;
+    for (int k = 0; k < heads_; ++k) {
+        Head& head = ch.heads[k];
+        advancePlayHead(ch, head, head_rate_[k], warp[k]);
+        signal_t curr = readFromPlayHead(ch, head);
+        curr = fadeNearOverlap(ch, head, curr);
+        curr = SATURATOR(curr);
+        curr = filter_gain_ * bandpassFilter(head, curr);
+        fb += head_level_[k] * curr;
+        wet += head_gain_[c][k] * curr;
+    }
 
     // Write back to tape.
-    ch.buf[ch.rec_csr] = in + curr * feedback_;
+    ch.tape.write(in + fb * feedback_);
 
     advanceRecHead(ch);
 
-    if (mix_ < 0.5) {
-        // dry full vol, fade in wet
-        return in + 2.0 * mix_ * curr;
-    } else {
-        // wet full vol, fade out dry
-        return curr + 2.0 * (1.0 - mix_) * in;
+    return wet;
+}
+
+// Block version of process() for all channels, for when no params are
+// moving. Does up to n samples and returns how many it did, writing the
+// wet signal to out.
+//
+// Feedback is written back to the tape only at the end of the block, so
+// the block stops short of the first sample whose play head would read a
+// sample written within it, on any head of any channel. With the 10ms
+// minimum delay that only happens where the heads cross.
+
+int FloatyPlugin::processBlock(const float** in, float** out, const int n) {
+    float warp[MAX_HEADS][BLOCK_LEN];
+    signal_t curr[NUM_CHANNELS * MAX_HEADS][BLOCK_LEN];
+    const int lanes = NUM_CHANNELS * heads_;
+
+    for (int k = 0; k < heads_; ++k) {
+        float w = warp_mod_[k];
+        for (int i = 0; i < n; ++i) {
+            w += warp_step_[k];
+            warp[k][i] = w;
+        }
+    }
+
+    // Read back from tape, a lane per head. If one has to stop early, go
+    // back and redo them all to match.
+    int64_t play_csr[NUM_CHANNELS * MAX_HEADS];
+    for (int l = 0; l < lanes; ++l) {
+        play_csr[l] = laneHead(l).play_csr;
+    }
+    int len = n;
+    for (int l = 0; l < lanes;) {
+        const int k = l % heads_;
+        const int done = readBlock(channels_[l / heads_], laneHead(l), head_rate_[k], warp[k], curr[l], len);
+        if (done < len) {
+            for (int r = 0; r <= l; ++r) {
+                laneHead(r).play_csr = play_csr[r];
+            }
+            len = done;
+            l = 0;
+        } else {
+            ++l;
+        }
     }
+    if (len > 0) {
+        for (int k = 0; k < heads_; ++k) {
+            warp_mod_[k] = warp[k][len - 1];
+        }
+    }
+
+    for (int l = 0; l < lanes; ++l) {
+        SATURATOR.processBlock(curr[l], curr[l], len);
+    }
+    bandpassBlock(curr, lanes, len);
+
+    for (int c = 0; c < NUM_CHANNELS; ++c) {
+        Channel& ch = channels_[c];
+        const signal_t (* const head_curr)[BLOCK_LEN] = curr + c * heads_;
+
+        // Sum the heads.
+        signal_t fb[BLOCK_LEN];
+        signal_t* const wet = out[c];
+        for (int i = 0; i < len; ++i) {
+            fb[i] = head_level_[0] * head_curr[0][i];
+            wet[i] = head_gain_[c][0] * head_curr[0][i];
+        }
+        for (int k = 1; k < heads_; ++k) {
+            const float level = head_level_[k];
+            const float gain = head_gain_[c][k];
+            for (int i = 0; i < len; ++i) {
+                fb[i] += level * head_curr[k][i];
+                wet[i] += gain * head_curr[k][i];
+            }
+        }
+
+        // Write back to tape.
+        for (int i = 0; i < len; ++i) {
+            fb[i] = in[c][i] + fb[i] * feedback_;
+        }
+        ch.tape.writeBlock(fb, len);
+        ch.rec_csr += len;
+        if (ch.rec_csr >= ch.getModPoint()) {
+            ch.rec_csr -= ch.getModPoint();
+        }
+    }
+    return len;
 }
 
-// Advances the play head around the tape loop (w/ modulation).
+// Moves head over up to n samples at rate times the playback rate, with
+// the warp for each in warp, and reads it into out, faded near the record
+// head. The record head is walked alongside and put back. Returns how many
+// samples it did: it stops before a sample that would need a tape sample
+// the block hasn't written yet.
+
+int FloatyPlugin::readBlock(Channel& ch, Head& head, const float rate, const float* warp,
+        signal_t* out, const int n) {
+    signal_t taps[MAX_TAPS * BLOCK_LEN];
+    samples_frac_t fraction[BLOCK_LEN] = {};
+    float overlap_mult[BLOCK_LEN];
+    const samples_t rec_csr = ch.rec_csr;
+
+    // The tape's write head is still at the start of the block, so sample
+    // len can only use samples more than len old.
+    int len = 0;
+    for (; len < n; ++len) {
+        const int64_t play_csr = head.play_csr;
+        advancePlayHead(ch, head, rate, warp[len]);
+        const PlayPoint p = locatePlayHead(ch, head);
+        if (!readTaps<BLOCK_LEN>(ch, p, len, taps, len)) {
+            head.play_csr = play_csr;
+            break;
+        }
+        fraction[len] = p.fraction;
+        overlap_mult[len] = fadeNearOverlap(ch, head, 1.0);
+        advanceRecHead(ch);
+    }
+    ch.rec_csr = rec_csr;
 
-void FloatyPlugin::advancePlayHead(Channel& ch) {
-    ch.play_csr += playback_rate_;
+    interpolate<BLOCK_LEN>(taps, fraction, out, len);
+    for (int i = 0; i < len; ++i) {
+        out[i] *= overlap_mult[i];
+    }
+    return len;
+}
 
-    // clamp warp_amount_ to prevent overruns.
-    // magic number chosen experimentally.
-    float max_warp_amount = ((channel_offset_ * delay_ / 100.0) - SMOOTH_OVERLAP) * warp_rate_hz_ / 16000.0;
-    double warp = fmin(max_warp_amount, warp_amount_) * sin(warp_counter_);
-    ch.play_csr += warp;
-    warp_counter_ += warp_rate_rad_;
-    ch.play_csr = fmod(ch.play_csr + (samples_frac_t) ch.getModPoint(), ch.getModPoint());
+// Advances a play head around the tape loop (w/ modulation). rate is its
+// multiple of the playback rate, and warp its current warp, from
+// fixWarp().
+
+void FloatyPlugin::advancePlayHead(const Channel& ch, Head& head, const float rate, const float warp) {
+    head.play_csr += (int64_t) ((playback_rate_ * rate + (double) warp) * PLAY_ONE);
+
+    // the head moves less than a loop per sample, so one wrap will do.
+    const int64_t loop = (int64_t) ch.getModPoint() << PLAY_FRAC_BITS;
+    if (head.play_csr >= loop) {
+        head.play_csr -= loop;
+    } else if (head.play_csr < 0) {
+        head.play_csr += loop;
+    }
+}
+
+// Finds the sample at or before a play head.
+
+FloatyPlugin::PlayPoint FloatyPlugin::locatePlayHead(const Channel& ch, const Head& head) const {
+    PlayPoint p;
+    const samples_t play_csr0 = head.play_csr >> PLAY_FRAC_BITS;
+    p.age = ch.rec_csr - play_csr0;
+    if (p.age <= 0) {
+        p.age += ch.getModPoint();
+    }
+    p.fraction = (head.play_csr & (PLAY_ONE - 1)) * (1.0 / PLAY_ONE);
+    return p;
+}
+
+int FloatyPlugin::interpolationTaps() const {
+    switch (interpolation_) {
+        case INTERP_HERMITE:
+        case INTERP_LAGRANGE:
+            return 4;
+        case INTERP_SINC:
+            return 8;
+        default:
+            return 2;
+    }
+}
+
+// Reads the tape samples around p into taps[k * STRIDE + i] for k in
+// [0, interpolationTaps()), oldest first, ending with the second sample
+// after the play head for the 4-point interpolators and the fourth for
+// sinc. Ages wrap round the tape loop. Returns false, having read nothing
+// useful, if any of them is newer samples old or less.
+
+template <int STRIDE>
+bool FloatyPlugin::readTaps(const Channel& ch, const PlayPoint& p, const samples_t newer,
+        signal_t* taps, const int i) const {
+    const int n = interpolationTaps();
+    const samples_t loop = ch.getModPoint();
+    bool ok = true;
+    for (int k = 0; k < n; ++k) {
+        samples_t age = p.age + n / 2 - 1 - k;
+        if (age <= 0) {
+            age += loop;
+        } else if (age > loop) {
+            age -= loop;
+        }
+        ok = ok && age > newer;
+        taps[k * STRIDE + i] = ch.tape.read(age - newer);
+    }
+    return ok;
+}
+
+// Sets sample to the current value under a playhead.
+
+signal_t FloatyPlugin::readFromPlayHead(const Channel& ch, const Head& head) const {
+    signal_t taps[MAX_TAPS];
+    const PlayPoint p = locatePlayHead(ch, head);
+    signal_t out;
+    readTaps<1>(ch, p, 0, taps, 0);
+    interpolate<1>(taps, &p.fraction, &out, 1);
+    return out;
 }
 
-// Sets sample to the current value under playhead.
+// Fractional-delay kernels, each over a block of reads. taps[k * STRIDE + i]
+// is the k'th tape sample for read i, as laid out by readTaps(): STRIDE is
+// BLOCK_LEN for a block, 1 for a single read.
+
+namespace {
+
+    template <int STRIDE>
+    void interpolateLinear(const signal_t* taps, const samples_frac_t* fraction,
+            signal_t* out, const int n) {
+        for (int i = 0; i < n; ++i) {
+            // LERP between both positions
+            const signal_t s0 = taps[0 * STRIDE + i] * (1.0 - fraction[i]);
+            const signal_t s1 = taps[1 * STRIDE + i] * (fraction[i]);
+            out[i] = s0 + s1;
+        }
+    }
+
+    template <int STRIDE>
+    void interpolateHermite(const signal_t* taps, const samples_frac_t* fraction,
+            signal_t* out, const int n) {
+        for (int i = 0; i < n; ++i) {
+            const signal_t xm1 = taps[0 * STRIDE + i];
+            const signal_t x0 = taps[1 * STRIDE + i];
+            const signal_t x1 = taps[2 * STRIDE + i];
+            const signal_t x2 = taps[3 * STRIDE + i];
+            const signal_t c1 = 0.5f * (x1 - xm1);
+            const signal_t c2 = xm1 - 2.5f * x0 + 2.0f * x1 - 0.5f * x2;
+            const signal_t c3 = 0.5f * (x2 - xm1) + 1.5f * (x0 - x1);
+            const samples_frac_t f = fraction[i];
+            out[i] = ((c3 * f + c2) * f + c1) * f + x0;
+        }
+    }
 
-signal_t FloatyPlugin::readFromPlayHead(const Channel& ch) const {
-    // Get interpolation data from both sides of floating-point sample location.
-    samples_t play_csr0 = ch.play_csr;
-    samples_t play_csr1 = (play_csr0 + 1) % ch.getModPoint();
-    samples_frac_t fraction = ch.play_csr - play_csr0;
+    template <int STRIDE>
+    void interpolateLagrange(const signal_t* taps, const samples_frac_t* fraction,
+            signal_t* out, const int n) {
+        for (int i = 0; i < n; ++i) {
+            const samples_frac_t d = fraction[i];
+            const samples_frac_t dp1 = d + 1.0f;
+            const samples_frac_t dm1 = d - 1.0f;
+            const samples_frac_t dm2 = d - 2.0f;
+            out[i] = (-1.0f / 6.0f) * d * dm1 * dm2 * taps[0 * STRIDE + i]
+                    + 0.5f * dp1 * dm1 * dm2 * taps[1 * STRIDE + i]
+                    - 0.5f * dp1 * d * dm2 * taps[2 * STRIDE + i]
+                    + (1.0f / 6.0f) * dp1 * d * dm1 * taps[3 * STRIDE + i];
+        }
+    }
+
+    // Blackman-windowed sinc, one row of coefficients per fraction step
+    // plus one so a row and the next can always be blended. Shared by all
+    // instances; built by the first one constructed.
+
+    float sinc_table[SINC_PHASES + 1][MAX_TAPS];
+
+    template <int STRIDE>
+    void interpolateSinc(const signal_t* taps, const samples_frac_t* fraction,
+            signal_t* out, const int n) {
+        for (int i = 0; i < n; ++i) {
+            const samples_frac_t phase = fraction[i] * SINC_PHASES;
+            const int row = phase;
+            const float blend = phase - row;
+            const float* const c0 = sinc_table[row];
+            const float* const c1 = sinc_table[row + 1];
+            signal_t sum = 0;
+            for (int k = 0; k < MAX_TAPS; ++k) {
+                sum += (c0[k] + blend * (c1[k] - c0[k])) * taps[k * STRIDE + i];
+            }
+            out[i] = sum;
+        }
+    }
+
+    bool buildSincTable() {
+        for (int row = 0; row <= SINC_PHASES; ++row) {
+            // tap k is k - 3 samples from the one before the play head.
+            const double fraction = (double) row / SINC_PHASES;
+            double sum = 0;
+            for (int k = 0; k < MAX_TAPS; ++k) {
+                const double x = k - 3 - fraction;
+                const double sinc = (x == 0) ? 1.0 : sin(PI * x) / (PI * x);
+                const double w = 0.42 + 0.5 * cos(PI * x / 4.0) + 0.08 * cos(2.0 * PI * x / 4.0);
+                sinc_table[row][k] = sinc * w;
+                sum += sinc * w;
+            }
+            // unity gain at DC
+            for (int k = 0; k < MAX_TAPS; ++k) {
+                sinc_table[row][k] /= sum;
+            }
+        }
+        return true;
+    }
+}
 
-    // LERP between both positions
-    const signal_t s0 = ch.buf[play_csr0] * (1.0 - fraction);
-    const signal_t s1 = ch.buf[play_csr1] * (fraction);
-    return s0 + s1;
+void FloatyPlugin::initSincTable() {
+    static const bool built = buildSincTable();
+    (void) built;
+}
+
+template <int STRIDE>
+void FloatyPlugin::interpolate(const signal_t* taps, const samples_frac_t* fraction,
+        signal_t* out, const int n) const {
+    switch (interpolation_) {
+        case INTERP_HERMITE:
+            interpolateHermite<STRIDE>(taps, fraction, out, n);
+            break;
+        case INTERP_LAGRANGE:
+            interpolateLagrange<STRIDE>(taps, fraction, out, n);
+            break;
+        case INTERP_SINC:
+            interpolateSinc<STRIDE>(taps, fraction, out, n);
+            break;
+        default:
+            interpolateLinear<STRIDE>(taps, fraction, out, n);
+            break;
+    }
 }
 
 // Dampen value if play/rec cursor overlap to prevent clicks.
 
-signal_t FloatyPlugin::fadeNearOverlap(const Channel& ch, signal_t in) const {
-    samples_frac_t overlap_dist = fabs((fmod(ch.play_csr, ch.getModPoint())) - (float) (ch.rec_csr % ch.getModPoint()));
+signal_t FloatyPlugin::fadeNearOverlap(const Channel& ch, const Head& head, signal_t in) const {
+    const int64_t rec_csr = (int64_t) ch.rec_csr << PLAY_FRAC_BITS;
+    samples_frac_t overlap_dist = fabs((head.play_csr - rec_csr) * (1.0 / PLAY_ONE));
     float overlap_mult = (overlap_dist >= SMOOTH_OVERLAP) ? 1.0 : (overlap_dist / SMOOTH_OVERLAP);
     return in * overlap_mult;
 }
@@ -333,24 +931,50 @@ signal_t FloatyPlugin::fadeNearOverlap(const Channel& ch, signal_t in) const {
 // Advances the record head around the tape loop (linear).
 
 void FloatyPlugin::advanceRecHead(Channel& ch) {
-    ch.rec_csr = (ch.rec_csr + 1) % ch.getModPoint();
+    ch.rec_csr += 1;
+    if (ch.rec_csr >= ch.getModPoint()) {
+        ch.rec_csr = 0;
+    }
 }
 
-signal_t FloatyPlugin::saturate(const signal_t in) const {
-    float shaper_amt = 3.0f - 0.8f * in;
-    return fmax(-CLAMP, fmin(CLAMP, CLAMP * ((1.0 + shaper_amt) * in) / (1.0 + (shaper_amt * fabs(in)))));
+// Applies a bandpass filter to the current sample.
+
+float FloatyPlugin::bandpassFilter(Head& head, const float in) {
+    return filters_.highpass(head.filter, filters_.lowpass(head.filter, in));
 }
 
-// Applies a bandpass filter to the current sample.
+// Applies the bandpass filter and its gain to a block on every lane. The
+// filters are serial within a lane, so running the lanes side by side in
+// one pass overlaps their dependency chains.
+
+void FloatyPlugin::bandpassBlock(signal_t curr[][BLOCK_LEN], const int lanes, const int n) {
+    const int MAX_LANES = NUM_CHANNELS * MAX_HEADS;
+    Filter::State states[MAX_LANES];
+    float* bufs[MAX_LANES] = {};
+    for (int l = 0; l < lanes; ++l) {
+        states[l] = laneHead(l).filter;
+        bufs[l] = curr[l];
+    }
+    filters_.processLanes<true, true, MAX_LANES>(states, bufs, lanes, n);
+    for (int l = 0; l < lanes; ++l) {
+        laneHead(l).filter = states[l];
+    }
 
-float FloatyPlugin::bandpassFilter(Channel& ch, const float in) {
-    // LPF
-    ch.v0 = (lpf_.one_minus_rc) * ch.v0 + lpf_.c * (in - ch.v1);
-    ch.v1 = (lpf_.one_minus_rc) * ch.v1 + lpf_.c * ch.v0;
-    // HPF
-    ch.hv0 = (hpf_.one_minus_rc) * ch.hv0 + hpf_.c * (ch.v1 - ch.hv1);
-    ch.hv1 = (hpf_.one_minus_rc) * ch.hv1 + hpf_.c * ch.hv0;
-    return ch.v1 - ch.hv1;
+    float gain[BLOCK_LEN];
+    if (filter_gain_.fillBlock(gain, n)) {
+        for (int l = 0; l < lanes; ++l) {
+            for (int i = 0; i < n; ++i) {
+                curr[l][i] *= gain[i];
+            }
+        }
+    } else {
+        const float g = filter_gain_;
+        for (int l = 0; l < lanes; ++l) {
+            for (int i = 0; i < n; ++i) {
+                curr[l][i] *= g;
+            }
+        }
+    }
 }
 
 // Per-channel processing.
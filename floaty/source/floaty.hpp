@@ -26,9 +26,22 @@
 #include "math.h"
 #include "util.hpp"
 
-const samples_t MAX_BUF = 48000 * 1.2; // 1.2 seconds at 48kHz
+// the wet path, tape and all, runs at 1/RATE_DIV of the plugin's rate.
+const samples_t MAX_BUF = 48000 * 1.2 / RATE_DIV; // 1.2 seconds at 48kHz
+const int TAPE_BITS = (RATE_DIV == 2) ? 15 : 16; // tape storage, at least MAX_BUF
+const int PLAY_FRAC_BITS = 32; // play head is fixed point
+const int64_t PLAY_ONE = (int64_t) 1 << PLAY_FRAC_BITS;
+const int BLOCK_LEN = 64; // longest run processed as block stages
+const int MAX_TAPS = 8; // widest interpolator
+const int SINC_PHASES = 64; // windowed-sinc table steps per sample
+const int NUM_CHANNELS = DISTRHO_PLUGIN_NUM_OUTPUTS; // 2 in the stereo build
+const int MAX_HEADS = 4; // play heads sharing each tape
+const float HEAD_DECAY = 0.8; // each extra head's level relative to the last
+const float HEAD_SPREAD = 0.6; // pan of the outermost heads, stereo build only
+const samples_t GLIDE_LEN = 4800 / RATE_DIV; // delay changes take 0.1s at 48kHz
 const samples_frac_t SMOOTH_OVERLAP = 128.0f; // Smooth out if rec/play csr overlap.
 const signal_t CLAMP = 0.6;
+const RationalShaper SATURATOR(3.0, CLAMP, -0.8, CLAMP); // harder on negative swings
 
 const int NUM_PROGRAMS = 6;
 
@@ -42,60 +55,149 @@ public:
         PARAM_WARP,
         PARAM_FILTER,
         PARAM_PLAYBACK_RATE,
-        PARAM_COUNT
+        PARAM_INTERPOLATION,
+        PARAM_TAPS,
+
+        // per-head trims over the layout Taps sets up, MAX_HEADS of each.
+        PARAM_HEAD_RATE,
+        PARAM_HEAD_LEVEL = PARAM_HEAD_RATE + MAX_HEADS,
+#ifdef FLOATY_STEREO
+        PARAM_HEAD_PAN = PARAM_HEAD_LEVEL + MAX_HEADS,
+        PARAM_COUNT = PARAM_HEAD_PAN + MAX_HEADS
+#else
+        PARAM_COUNT = PARAM_HEAD_LEVEL + MAX_HEADS
+#endif
     };
 
-    struct Filter {
-        SmoothParam<float> c = 0.3;
-        SmoothParam<float> one_minus_rc = 0.98;
+    // How the play head reads between tape samples.
 
-        void tick() {
-            c.tick();
-            one_minus_rc.tick();
-        }
+    enum Interpolation {
+        INTERP_LINEAR,
+        INTERP_HERMITE,
+        INTERP_LAGRANGE,
+        INTERP_SINC,
+        INTERP_COUNT
     };
 
+    // the bandpass filter, an LPF then an HPF.
+    typedef TwoPoleFilter<> Filter;
+
     struct Channel {
 
+        // A play head, in fixed point, and its filter state.
+
+        struct Head {
+            int64_t play_csr = 0;
+            Filter::State filter;
+        };
+
         Channel() {
-            setDelay(1000);
+            reset(1000, 1);
         }
 
-        void setDelay(samples_t delay) {
+        // Sets the delay at once and spreads the play heads evenly behind
+        // the record head, the first at the full delay. Their filters start
+        // from silence.
+
+        void reset(samples_t delay, const int heads) {
             if (delay == 0) {
                 return;
             }
 
-            if (play_csr != 0) {
-                memset(buf, 0, MAX_BUF * sizeof (signal_t));
+            this->delay = delay;
+            mod_point = fmin(MAX_BUF, delay * 2);
+            loop = mod_point;
+            glide_step = 0;
+            rec_csr = mod_point - delay;
+            for (int k = 0; k < heads; ++k) {
+                const samples_t behind = (int64_t) rec_csr * (heads - k) / heads;
+                this->heads[k].play_csr = (int64_t) (rec_csr - behind) << PLAY_FRAC_BITS;
+                this->heads[k].filter = Filter::State();
+            }
+        }
+
+        // Sets a new delay for glide() to reach over GLIDE_LEN samples.
+        // Nothing is cleared: the tape holds MAX_BUF samples of history
+        // whatever the loop length.
+
+        void setDelay(samples_t delay) {
+            if (delay == 0) {
+                return;
             }
 
-            // TODO - this should set a tape speed (maybe a level up)
-            // and everything should just speed up to get to roughly this
-            // value.
             this->delay = delay;
-            play_csr = 0;
-            rec_csr = getModPoint() - delay;
+            glide_step = (fmin(MAX_BUF, delay * 2) - loop) / GLIDE_LEN;
         }
 
-        samples_t getModPoint() const {
-            return fmin(MAX_BUF, delay * 2);
+        bool isGliding() const {
+            return glide_step != 0;
         }
 
-        // tape state
-        samples_t delay = 1;
-        samples_t rec_csr = 0;
-        double play_csr = 0;
+        // Moves a sample's worth toward the delay set, like changing the
+        // tape speed: the loop stretches and every play head's age
+        // stretches with it.
+
+        void glide() {
+            if (!isGliding()) {
+                return;
+            }
+            const double target = fmin(MAX_BUF, delay * 2);
+            loop += glide_step;
+            if ((glide_step > 0) ? loop >= target : loop <= target) {
+                loop = target;
+                glide_step = 0;
+            }
 
-        // tape buffer
-        signal_t buf[MAX_BUF] = {};
+            const samples_t next_mod_point = lrint(loop);
+            if (next_mod_point == mod_point) {
+                return;
+            }
+            const double stretch = (double) next_mod_point / mod_point;
+            const int64_t rec = (int64_t) rec_csr << PLAY_FRAC_BITS;
+            const int64_t old_loop = (int64_t) mod_point << PLAY_FRAC_BITS;
+            const int64_t new_loop = (int64_t) next_mod_point << PLAY_FRAC_BITS;
+            const samples_t next_rec_csr = rec_csr % next_mod_point;
+            const int64_t next_rec = (int64_t) next_rec_csr << PLAY_FRAC_BITS;
+            for (int k = 0; k < MAX_HEADS; ++k) {
+                int64_t age = rec - heads[k].play_csr;
+                if (age <= 0) {
+                    age += old_loop;
+                }
+                int64_t play_csr = next_rec - (int64_t) (age * stretch);
+                if (play_csr < 0) {
+                    play_csr += new_loop;
+                }
+                heads[k].play_csr = play_csr;
+            }
+            rec_csr = next_rec_csr;
+            mod_point = next_mod_point;
+        }
 
-        // filter state
-        float v0 = 0;
-        float v1 = 0;
-        float hv0 = 0;
-        float hv1 = 0;
+        samples_t getModPoint() const {
+            return mod_point;
+        }
 
+        // tape state. the tape is a loop of getModPoint() samples; rec_csr
+        // and the heads' play_csr are positions on it. loop is the length
+        // mid-glide, in fractional samples.
+        samples_t delay = 1;
+        samples_t mod_point = 2;
+        double loop = 2;
+        double glide_step = 0;
+        samples_t rec_csr = 0;
+        Head heads[MAX_HEADS];
+
+        // tape buffer. position pos on the loop was last recorded
+        // rec_csr - pos samples ago (plus a loop, if that's not positive).
+        TapeBuffer<TAPE_BITS> tape;
+
+#ifdef HALF_RATE
+        // rate conversion either side of the wet path, and the dry signal
+        // delayed to match.
+        HalfbandDecimator decimator;
+        HalfbandInterpolator interpolator;
+        TapeBuffer<6, FloatSample> dry;
+#endif
     };
 
     /**
@@ -103,8 +205,20 @@ public:
       You must set all parameter values to their defaults, matching the value in initParameter().
      */
     FloatyPlugin() : Plugin(PARAM_COUNT, NUM_PROGRAMS, 0) {
-        srate = getSampleRate();
+        srate = getSampleRate() / RATE_DIV;
+#if DISTRHO_PLUGIN_WANT_LATENCY
+        setLatency(HALFBAND_LATENCY);
+#endif
+        initSincTable();
+        initFilterTable();
+        for (int k = 0; k < MAX_HEADS; ++k) {
+            head_rate_[k] = 1;
+            head_trim_[k] = 1;
+            head_pan_[k] = 0;
+        }
+        fixHeadParams();
         loadProgram(0);
+        resetHeads();
     };
 
 protected:
@@ -121,7 +235,11 @@ protected:
       This label is a short restricted name consisting of only _, a-z, A-Z and 0-9 characters.
      */
     const char* getLabel() const noexcept override {
+#ifdef FLOATY_STEREO
+        return "FloatyStereo";
+#else
         return "Floaty";
+#endif
     }
 
     /**
@@ -136,7 +254,17 @@ protected:
         "Feedback: feedback (can go into oscillation!)\n"
         "Warp: modulation - left side is mellow, right side is fast\n"
         "Filter: bandpass frequency/resonance\n"
-        "Rate: playback speed, cycles from -200% to 200% speed (unity in middle)";
+        "Rate: playback speed, cycles from -200% to 200% speed (unity in middle)\n"
+        "Interpolation: how the tape is read between samples - linear, cubic\n"
+        "Hermite, 4-point Lagrange or 8-tap windowed sinc, in order of CPU cost\n"
+        "Taps: 1 to 4 play heads on the one tape, spread evenly over the delay\n"
+        "Head Rate: a head's speed, as a multiple of Playback Rate\n"
+#ifdef FLOATY_STEREO
+        "Head Level: a head's level, as a share of its place in the layout\n"
+        "Head Pan: moves a head from its place in the stereo spread";
+#else
+        "Head Level: a head's level, as a share of its place in the layout";
+#endif
     }
 
     /**
@@ -168,7 +296,11 @@ protected:
       @see d_cconst()
      */
     int64_t getUniqueId() const noexcept override {
+#ifdef FLOATY_STEREO
+        return d_cconst('r', 'c', 'F', 's');
+#else
         return d_cconst('r', 'c', 'F', 'l');
+#endif
     }
 
     // -------------------------------------------------------------------
@@ -180,12 +312,27 @@ protected:
      */
     void initParameter(uint32_t index, Parameter& parameter) override;
 
+    //
+    void initHeadParameter(uint32_t index, Parameter& parameter);
+
+    //
+    void setHeadParameterValue(uint32_t index, float value);
+
     //
     void fixFilterParams();
 
     //
     void fixDelayParams();
 
+    //
+    void resetHeads();
+
+    //
+    samples_t channelDelay(const int c) const;
+
+    //
+    void fixHeadParams();
+
     // -------------------------------------------------------------------
     // Internal data
 
@@ -208,18 +355,48 @@ protected:
     void run(const float** inputs, float** outputs, uint32_t frames) override;
 
 private:
-    void advancePlayHead(Channel& pc);
+    // The tape sample at or just before the play head, by age, and how far
+    // past it the play head is.
+
+    struct PlayPoint {
+        samples_t age;
+        samples_frac_t fraction;
+    };
+
+    typedef Channel::Head Head;
+
+    void fixWarp();
+    void advancePlayHead(const Channel& ch, Head& head, const float rate, const float warp);
+    PlayPoint locatePlayHead(const Channel& ch, const Head& head) const;
+    int interpolationTaps() const;
+    template <int STRIDE>
+    bool readTaps(const Channel& ch, const PlayPoint& p, const samples_t newer,
+            signal_t* taps, const int i) const;
+    template <int STRIDE>
+    void interpolate(const signal_t* taps, const samples_frac_t* fraction,
+            signal_t* out, const int n) const;
+    static void initSincTable();
+    static void initFilterTable();
     void advanceRecHead(Channel& ch);
-    signal_t fadeNearOverlap(const Channel& ch, const signal_t in) const;
-    signal_t readFromPlayHead(const Channel& ch) const;
-    signal_t saturate(const signal_t in) const;
-    signal_t bandpassFilter(Channel& ch, const signal_t in);
-    signal_t process(Channel& ch, const signal_t in);
+    signal_t fadeNearOverlap(const Channel& ch, const Head& head, const signal_t in) const;
+    signal_t readFromPlayHead(const Channel& ch, const Head& head) const;
+    signal_t bandpassFilter(Head& head, const signal_t in);
+    void processWet(const float** in, float** out, const int n);
+    void mix(const float** dry, const float** wet, float** out, const int n);
+    signal_t process(Channel& ch, const int c, const signal_t in, const float* warp);
+    int processBlock(const float** in, float** out, const int n);
+    int readBlock(Channel& ch, Head& head, const float rate, const float* warp, signal_t* out,
+            const int n);
+    void bandpassBlock(signal_t curr[][BLOCK_LEN], const int lanes, const int n);
+
+    // Heads are processed as lanes, channel by channel.
+
+    Head& laneHead(const int lane) {
+        return channels_[lane / heads_].heads[lane % heads_];
+    }
 
-    Channel left_;
-    Channel right_;
-    Filter lpf_;
-    Filter hpf_;
+    Channel channels_[NUM_CHANNELS]; // left, then right in the stereo build
+    Filter filters_;
 
     // TODO move user-specified params into a class, wrap in getters/setters
     // and move logic out of FloatyPlugin.
@@ -231,25 +408,53 @@ private:
     float warp_ = 49;
 
     float warp_rate_hz_ = 0.1;
-    float warp_rate_rad_ = 2.0 * PI * 0.1 / 48000.0;
     SmoothParam<float> warp_amount_ = 0.01;
 
     float filter_ = 25;
     SmoothParam<float> filter_gain_ = 1.0;
     SmoothParam<samples_frac_t, 9600> playback_rate_ = 1.0;
     float channel_offset_ = 98.0;
-    double warp_counter_ = 0; // this will probably lose resolution and go weird
-
-    samples_t srate = 48000;
-
+    int interpolation_ = INTERP_LINEAR;
+    Lfo warp_lfo_[MAX_HEADS]; // one per head, phases spread; steps once per control tick
+
+    // each head's warp, added to the playback rate. It ramps from one
+    // control tick's LFO value to the next by warp_step_ per sample.
+    float warp_mod_[MAX_HEADS] = {};
+    float warp_step_[MAX_HEADS] = {};
+    ControlClock control_; // at the wet path's rate
+
+    // multi-tap. a head's level is its share of the feedback; its gain
+    // on each output adds the pan. The per-head params trim the layout:
+    // head_rate_ scales playback_rate_, head_trim_ scales the level and
+    // head_pan_ is added to the pan.
+    int heads_ = 1;
+    float head_level_[MAX_HEADS] = {1};
+    float head_gain_[NUM_CHANNELS][MAX_HEADS] = {};
+    float head_rate_[MAX_HEADS];
+    float head_trim_[MAX_HEADS];
+    float head_pan_[MAX_HEADS];
+
+    samples_t srate = 48000; // the wet path's rate
+
+    // wet path params. mix_ is ticked by mix(), at the plugin's rate, and
+    // warp_amount_ by fixWarp(), at the control rate. Block runs move the
+    // filter and its gain themselves.
     void tick() {
-        mix_.tick();
         feedback_.tick();
-        warp_amount_.tick();
         filter_gain_.tick();
         playback_rate_.tick();
-        lpf_.tick();
-        hpf_.tick();
+        filters_.tick();
+    }
+
+    // true if no smoothed param is ramping and no delay is gliding, so
+    // tick() and glide() can be skipped.
+    bool isSettled() const {
+        for (int c = 0; c < NUM_CHANNELS; ++c) {
+            if (channels_[c].isGliding()) {
+                return false;
+            }
+        }
+        return feedback_.isSettled() && playback_rate_.isSettled();
     }
 };
 
@@ -8,6 +8,12 @@
 #define RC_UTIL_H
 
 #include "math.h"
+#include "stdint.h"
+#include "string.h"
+
+#ifdef __SSE__
+#include "immintrin.h"
+#endif
 
 const float PI = 3.141592653589793;
 
@@ -21,7 +27,97 @@ constexpr float DB_CO(float g) {
     return (g > -90.0f) ? powf(10.0f, g * 0.05f) : 0.0f;
 }
 
-// DC filter. Call process once per sample.
+/* RationalShaper is the soft clipper the plugins saturate with:
+ * scale * (1 + k) * x / (1 + k |x|), then clamped to +-limit. k sets how
+ * hard it bends (0 is linear); tilt leans k with the input's sign, as
+ * k + tilt * x, for an asymmetric curve. A limit of 0 leaves it unclamped.
+ *
+ * It works in single precision throughout. processBlock() runs 8 or 4
+ * samples at a time on AVX or SSE, with a reciprocal estimate and one
+ * Newton step standing in for the divide. That's good to about 23 bits.
+ * Elsewhere, and for the tail, it divides a sample at a time.
+ */
+
+class RationalShaper {
+public:
+
+    constexpr RationalShaper(const float k, const float limit = 0, const float tilt = 0,
+            const float scale = 1) : k(k), limit(limit), tilt(tilt), scale(scale) {
+    }
+
+    float operator()(const float in) const {
+        const float kx = k + tilt * in;
+        const float out = scale * (1.0f + kx) * in / (1.0f + kx * fabsf(in));
+        return (limit > 0) ? fmaxf(-limit, fminf(limit, out)) : out;
+    }
+
+    // in and out may be the same buffer.
+
+    void processBlock(const float* in, float* out, const int n) const {
+        int i = 0;
+#ifdef __AVX__
+        {
+            const __m256 one = _mm256_set1_ps(1.0f);
+            const __m256 two = _mm256_set1_ps(2.0f);
+            const __m256 sign = _mm256_set1_ps(-0.0f);
+            const __m256 vk = _mm256_set1_ps(k);
+            const __m256 vtilt = _mm256_set1_ps(tilt);
+            const __m256 vscale = _mm256_set1_ps(scale);
+            const __m256 hi = _mm256_set1_ps(limit);
+            const __m256 lo = _mm256_set1_ps(-limit);
+            for (; i + 8 <= n; i += 8) {
+                const __m256 x = _mm256_loadu_ps(in + i);
+                const __m256 kx = _mm256_add_ps(vk, _mm256_mul_ps(vtilt, x));
+                const __m256 num = _mm256_mul_ps(_mm256_mul_ps(vscale, _mm256_add_ps(one, kx)), x);
+                const __m256 den = _mm256_add_ps(one, _mm256_mul_ps(kx, _mm256_andnot_ps(sign, x)));
+                __m256 inv = _mm256_rcp_ps(den);
+                inv = _mm256_mul_ps(inv, _mm256_sub_ps(two, _mm256_mul_ps(den, inv)));
+                __m256 y = _mm256_mul_ps(num, inv);
+                if (limit > 0) {
+                    y = _mm256_max_ps(lo, _mm256_min_ps(hi, y));
+                }
+                _mm256_storeu_ps(out + i, y);
+            }
+        }
+#endif
+#ifdef __SSE__
+        {
+            const __m128 one = _mm_set1_ps(1.0f);
+            const __m128 two = _mm_set1_ps(2.0f);
+            const __m128 sign = _mm_set1_ps(-0.0f);
+            const __m128 vk = _mm_set1_ps(k);
+            const __m128 vtilt = _mm_set1_ps(tilt);
+            const __m128 vscale = _mm_set1_ps(scale);
+            const __m128 hi = _mm_set1_ps(limit);
+            const __m128 lo = _mm_set1_ps(-limit);
+            for (; i + 4 <= n; i += 4) {
+                const __m128 x = _mm_loadu_ps(in + i);
+                const __m128 kx = _mm_add_ps(vk, _mm_mul_ps(vtilt, x));
+                const __m128 num = _mm_mul_ps(_mm_mul_ps(vscale, _mm_add_ps(one, kx)), x);
+                const __m128 den = _mm_add_ps(one, _mm_mul_ps(kx, _mm_andnot_ps(sign, x)));
+                __m128 inv = _mm_rcp_ps(den);
+                inv = _mm_mul_ps(inv, _mm_sub_ps(two, _mm_mul_ps(den, inv)));
+                __m128 y = _mm_mul_ps(num, inv);
+                if (limit > 0) {
+                    y = _mm_max_ps(lo, _mm_min_ps(hi, y));
+                }
+                _mm_storeu_ps(out + i, y);
+            }
+        }
+#endif
+        for (; i < n; ++i) {
+            out[i] = (*this)(in[i]);
+        }
+    }
+
+private:
+    float k;
+    float limit;
+    float tilt;
+    float scale;
+};
+
+// DC filter. Call process once per sample, or processBlock once per block.
 
 class DcFilter {
 public:
@@ -32,13 +128,343 @@ public:
         return out;
     }
 
+    // in and out may be the same buffer.
+
+    void processBlock(const signal_t* in, signal_t* out, const int n) {
+        signal_t y = this->out;
+        signal_t x1 = prv_in;
+        for (int i = 0; i < n; ++i) {
+            const signal_t x = in[i];
+            y = 0.99f * y + x - x1;
+            x1 = x;
+            out[i] = y;
+        }
+        this->out = y;
+        prv_in = x1;
+    }
+
 private:
     signal_t out = 0;
     signal_t prv_in = 0;
 };
 
+// Per-instance PRNG (xorshift32). Realtime safe and uncontended, unlike
+// rand(), and reproducible for a given seed.
+
+class Prng {
+public:
+
+    Prng(const uint32_t s = 0) {
+        seed(s);
+    }
+
+    void seed(const uint32_t s) {
+        // scramble so nearby seeds diverge; state must be non-zero.
+        state = s * 2654435761u + 0x9e3779b9u;
+        if (state == 0) {
+            state = 1;
+        }
+    }
+
+    uint32_t next() {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    // Uniform in [0, n), n > 0.
+
+    int nextInt(const int n) {
+        return ((uint64_t) next() * (uint32_t) n) >> 32;
+    }
+
+private:
+    uint32_t state;
+};
+
+/* Lfo is a sine oscillator for modulation. It rotates a unit phasor by a
+ * fixed angle each step, so a step is a complex multiply rather than a
+ * sin(), and there's no phase counter to grow and lose precision. The
+ * phasor's length is pulled back to 1 every step to stop it drifting.
+ */
+class Lfo {
+public:
+
+    // Sets the step in radians. The phase carries on from where it was.
+
+    void setRate(const double rad) {
+        if (rad != rate) {
+            rate = rad;
+            rot_c = cos(rad);
+            rot_s = sin(rad);
+        }
+    }
+
+    // Back to phase 0, or the given phase in radians.
+
+    void reset(const double phase = 0) {
+        c = cos(phase);
+        s = sin(phase);
+    }
+
+    // Returns the sine of the current phase and steps on.
+
+    float next() {
+        const float out = s;
+        const double c1 = c * rot_c - s * rot_s;
+        const double s1 = s * rot_c + c * rot_s;
+        const double norm = 1.5 - 0.5 * (c1 * c1 + s1 * s1);
+        c = c1 * norm;
+        s = s1 * norm;
+        return out;
+    }
+
+private:
+    double c = 1;
+    double s = 0;
+    double rate = 0;
+    double rot_c = 1;
+    double rot_s = 0;
+};
+
+/* Tape sample formats: how a tape stores signal_t samples. FloatSample
+ * stores them as they are. Int16Sample stores 16-bit fixed point over
+ * +/-INT16_RANGE, in half the memory, clipping beyond it; its rounding
+ * noise is about -89dB relative to 1.0. Block versions are plain loops
+ * so the compiler can vectorise the conversions.
+ *
+ * Building with TAPE16 defined makes TapeSample, the format plugins use
+ * for their tapes, Int16Sample.
+ */
+struct FloatSample {
+    typedef signal_t stored_t;
+
+    static stored_t pack(const signal_t in) {
+        return in;
+    }
+
+    static signal_t unpack(const stored_t in) {
+        return in;
+    }
+
+    static void packBlock(const signal_t* in, stored_t* out, const int n) {
+        memcpy(out, in, n * sizeof (stored_t));
+    }
+
+    static void unpackBlock(const stored_t* in, signal_t* out, const int n) {
+        memcpy(out, in, n * sizeof (stored_t));
+    }
+};
+
+const float INT16_RANGE = 4.0f; // Int16Sample full scale
+
+struct Int16Sample {
+    typedef int16_t stored_t;
+
+    // rounds by truncating from above zero, which vectorises where
+    // lrintf() doesn't.
+    static stored_t pack(const signal_t in) {
+        const float x = fmaxf(-32767.0f, fminf(32767.0f, in * (32767.0f / INT16_RANGE)));
+        return (int32_t) (x + 32768.5f) - 32768;
+    }
+
+    static signal_t unpack(const stored_t in) {
+        return in * (INT16_RANGE / 32767.0f);
+    }
+
+    static void packBlock(const signal_t* in, stored_t* out, const int n) {
+        for (int i = 0; i < n; ++i) {
+            out[i] = pack(in[i]);
+        }
+    }
+
+    static void unpackBlock(const stored_t* in, signal_t* out, const int n) {
+        for (int i = 0; i < n; ++i) {
+            out[i] = unpack(in[i]);
+        }
+    }
+};
+
+#ifdef TAPE16
+typedef Int16Sample TapeSample;
+#else
+typedef FloatSample TapeSample;
+#endif
+
+/* TapeBuffer is 2^BITS samples of power-of-two storage with a record head
+ * that wraps by masking, stored as FORMAT. Reads are by age, the number
+ * of samples since a position was written: read(1) is the last sample
+ * written, read(2) the one before. A tape loop of any logical length up
+ * to SIZE is the range of ages 1..length, so the loop length is up to the
+ * caller and never needs a modulo.
+ */
+template <int BITS, class FORMAT = TapeSample> class TapeBuffer {
+public:
+    static const uint32_t SIZE = 1u << BITS;
+    static const uint32_t MASK = SIZE - 1;
+
+    void write(const signal_t in) {
+        buf[write_csr & MASK] = FORMAT::pack(in);
+        write_csr += 1;
+    }
+
+    // Block version of write(); n must not exceed SIZE.
+
+    void writeBlock(const signal_t* in, const int n) {
+        const uint32_t at = write_csr & MASK;
+        const uint32_t first = SIZE - at < (uint32_t) n ? SIZE - at : n;
+        FORMAT::packBlock(in, buf + at, first);
+        FORMAT::packBlock(in + first, buf, n - first);
+        write_csr += n;
+    }
+
+    signal_t read(const uint32_t age) const {
+        return FORMAT::unpack(buf[(write_csr - age) & MASK]);
+    }
+
+private:
+    typename FORMAT::stored_t buf[SIZE] = {};
+    uint32_t write_csr = 0;
+};
+
+/* Halfband decimation and interpolation, for running a wet path at half
+ * the plugin's rate. Both use a 43-tap Blackman-windowed sinc halfband
+ * lowpass: flat to 0.2x the full rate, -46dB by 0.3x, and 21 samples of
+ * delay each way. Feed a decimator and an interpolator the same run
+ * lengths and they stay paired; HALFBAND_LATENCY is the delay through the
+ * two, in full-rate samples.
+ *
+ * Building with HALF_RATE defined makes RATE_DIV 2, for plugins that run
+ * their wet path through these.
+ */
+const int HALFBAND_SIDE_TAPS = 11;
+const int HALFBAND_LATENCY = 42;
+
+// non-zero taps either side of the 0.5 centre tap, nearest first.
+const float HALFBAND_COEFFS[HALFBAND_SIDE_TAPS] = {
+    0.315674379f,
+    -0.0983844659f,
+    0.0515216954f,
+    -0.0298811331f,
+    0.017457209f,
+    -0.00983916676f,
+    0.00518708368f,
+    -0.00247119411f,
+    0.00100198533f,
+    -0.000294415699f,
+    2.80235543e-05f,
+};
+
+#ifdef HALF_RATE
+const int RATE_DIV = 2;
+#else
+const int RATE_DIV = 1;
+#endif
+
+// A one-pole coefficient worked out for the full rate, moved so the pole
+// has the same cutoff at 1/RATE_DIV of it.
+
+inline float wetRateCoeff(const float c) {
+#ifdef HALF_RATE
+    return 1.0f - (1.0f - c) * (1.0f - c);
+#else
+    return c;
+#endif
+}
+
+class HalfbandDecimator {
+public:
+
+    // Takes n full-rate samples and writes a half-rate one to out for each
+    // pair completed. Returns how many it wrote.
+
+    int process(const signal_t* in, signal_t* out, const int n) {
+        int m = 0;
+        for (int i = 0; i < n;) {
+            const int len = (n - i < HALFBAND_BLOCK) ? n - i : HALFBAND_BLOCK;
+            memcpy(hist + HISTORY, in + i, len * sizeof (signal_t));
+            // sample k is hist[HISTORY + k]; each pair ends on its second.
+            const int first = second ? 0 : 1;
+            const int count = (len - first + 1) / 2;
+            for (int t = 0; t < count; ++t) {
+                const signal_t* const x = hist + first + 2 * t + HISTORY - 21;
+                signal_t y = 0.5f * x[0];
+                for (int j = 0; j < HALFBAND_SIDE_TAPS; ++j) {
+                    y += HALFBAND_COEFFS[j] * (x[2 * j + 1] + x[-2 * j - 1]);
+                }
+                out[m + t] = y;
+            }
+            memmove(hist, hist + len, HISTORY * sizeof (signal_t));
+            m += count;
+            second = second != (len & 1);
+            i += len;
+        }
+        return m;
+    }
+
+private:
+    static const int HALFBAND_BLOCK = 128;
+    static const int HISTORY = 42; // the filter's taps, less one
+    signal_t hist[HISTORY + HALFBAND_BLOCK] = {};
+    bool second = false;
+};
+
+class HalfbandInterpolator {
+public:
+
+    // Writes n full-rate samples to out, taking a half-rate one from in
+    // wherever the paired decimator completed a pair.
+
+    void process(const signal_t* in, signal_t* out, const int n) {
+        for (int i = 0; i < n;) {
+            const int len = (n - i < HALFBAND_BLOCK) ? n - i : HALFBAND_BLOCK;
+            const int count = (len + (second ? 1 : 0)) / 2;
+            memcpy(hist + HISTORY, in, count * sizeof (signal_t));
+            in += count;
+
+            // the even phase, for half-rate sample t = hist[HISTORY + t].
+            // the odd phase is just the centre tap.
+            signal_t even[HALFBAND_BLOCK / 2 + 1];
+            for (int t = 0; t < count; ++t) {
+                const signal_t* const v = hist + t + HISTORY - 10;
+                signal_t y = 0;
+                for (int j = 0; j < HALFBAND_SIDE_TAPS; ++j) {
+                    y += HALFBAND_COEFFS[j] * (v[j] + v[-1 - j]);
+                }
+                even[t] = 2.0f * y;
+            }
+
+            int t = 0;
+            for (int k = 0; k < len; ++k) {
+                if (second) {
+                    out[i + k] = even[t];
+                    held = hist[t + HISTORY - 10];
+                    t += 1;
+                } else {
+                    out[i + k] = held;
+                }
+                second = !second;
+            }
+            memmove(hist, hist + count, HISTORY * sizeof (signal_t));
+            i += len;
+        }
+    }
+
+private:
+    static const int HALFBAND_BLOCK = 128;
+    static const int HISTORY = 21; // the even phase's taps, less one
+    signal_t hist[HISTORY + HALFBAND_BLOCK / 2 + 1] = {};
+    signal_t held = 0;
+    bool second = false;
+};
+
 /* SmoothParam models parameter smoothing (LERP) over a fixed # samples
  * following parameter value updates.
+ *
+ * Per-sample users call tick() once per sample. Block users can check
+ * isSettled() once per block and use the scalar value when nothing is
+ * moving, or use fillBlock() to get the ramp for a whole block at once.
  */
 template <class T, int U = 2400 > class SmoothParam {
 public:
@@ -47,6 +473,10 @@ public:
     }
 
     SmoothParam<T, U>& operator=(T f) {
+        // re-assigning the current target doesn't restart the ramp.
+        if (f == end) {
+            return *this;
+        }
         start = value;
         end = f;
         t = 0;
@@ -67,6 +497,10 @@ public:
         return value;
     }
 
+    bool isSettled() const {
+        return t >= len;
+    }
+
     void complete() {
         t = len;
         value = end;
@@ -75,19 +509,448 @@ public:
     void tick() {
         if (t < len) {
             t += 1;
-            const float frac = ((float) t / (float) len);
+            const float frac = (float) t * inv_len;
+            value = (float) end * frac + (float) start * (1.0f - frac);
+        }
+    }
+
+    // Advances n samples without producing the intermediate values.
+
+    void tickBlock(const int n) {
+        if (t < len) {
+            t = (n < len - t) ? t + n : len;
+            const float frac = (float) t * inv_len;
             value = (float) end * frac + (float) start * (1.0f - frac);
-        } else {
-            value = end;
         }
     }
 
+    // Fills out[0, n) with the value for each of the next n samples (out[0]
+    // is the current value, as if tick() were called after each sample) and
+    // advances n samples. Returns false and leaves out untouched if settled,
+    // in which case the current value holds for the whole block.
+
+    bool fillBlock(T* out, const int n) {
+        if (t >= len) {
+            return false;
+        }
+        const int ramp = (n < len - t) ? n : len - t;
+        out[0] = value;
+        for (int i = 1; i <= ramp && i < n; ++i) {
+            const float frac = (float) (t + i) * inv_len;
+            out[i] = (float) end * frac + (float) start * (1.0f - frac);
+        }
+        for (int i = ramp + 1; i < n; ++i) {
+            out[i] = end;
+        }
+        tickBlock(n);
+        return true;
+    }
+
 private:
     T value = 0;
     T start = 0;
     T end = 0;
-    int t = 0;
+    int t = U;
     const int len = U;
+    static constexpr float inv_len = 1.0f / U;
+};
+
+/* FilterCoeffs is what a Filter knob setting maps to: the constants for
+ * the LPF and HPF, and the gain that compensates for them.
+ */
+struct FilterCoeffs {
+    float lc;
+    float l_one_minus_rc;
+    float hc;
+    float h_one_minus_rc;
+    float gain;
+};
+
+/* FilterTable tabulates a Filter knob's mapping over its 0-100 range at
+ * POINTS steps, so moving the knob (or sweeping it with an LFO) costs a
+ * lookup and a lerp rather than the powf()s behind each entry. Fill it
+ * once with build(), from a function giving the coefficients for a knob
+ * value.
+ */
+template <int POINTS = 1024> class FilterTable {
+public:
+
+    template <class F> void build(F coeffs) {
+        for (int i = 0; i <= POINTS; ++i) {
+            table[i] = coeffs(100.0f * i / POINTS);
+        }
+    }
+
+    FilterCoeffs lookup(const float knob) const {
+        const float pos = fminf(fmaxf(knob, 0.0f), 100.0f) * (POINTS / 100.0f);
+        const int i = (pos < POINTS) ? (int) pos : POINTS - 1;
+        const float frac = pos - i;
+        const FilterCoeffs& a = table[i];
+        const FilterCoeffs& b = table[i + 1];
+
+        FilterCoeffs out;
+        out.lc = a.lc + frac * (b.lc - a.lc);
+        out.l_one_minus_rc = a.l_one_minus_rc + frac * (b.l_one_minus_rc - a.l_one_minus_rc);
+        out.hc = a.hc + frac * (b.hc - a.hc);
+        out.h_one_minus_rc = a.h_one_minus_rc + frac * (b.h_one_minus_rc - a.h_one_minus_rc);
+        out.gain = a.gain + frac * (b.gain - a.gain);
+        return out;
+    }
+
+private:
+    FilterCoeffs table[POINTS + 1];
+};
+
+/* BlockIir runs a linear filter with N state variables IIR_BLOCK samples
+ * at a time in state-space form. A block's outputs and the state after it
+ * are matrix products of the state before it and the block's inputs.
+ * build() works the matrices out by running the filter's own per-sample
+ * recurrence. The products have no sample-to-sample dependency, so they
+ * vectorise; only the state carries from one block to the next. The
+ * recurrence itself can only run a sample at a time.
+ *
+ * Building with SERIAL_FILTERS defined keeps TwoPoleFilter on its
+ * per-sample recurrence, for comparison.
+ */
+const int IIR_BLOCK = 8;
+
+template <int N> class BlockIir {
+public:
+
+    // Works out the matrices from step(s, in), which runs one sample of
+    // the recurrence: it advances the state s by input in and returns the
+    // output.
+
+    template <class STEP> void build(STEP step) {
+        // each state variable's part in the outputs and the next state
+        for (int j = 0; j < N; ++j) {
+            double s[N] = {};
+            s[j] = 1;
+            for (int k = 0; k < IIR_BLOCK; ++k) {
+                from_state[j][k] = step(s, 0.0);
+            }
+            for (int i = 0; i < N; ++i) {
+                next_from_state[j][i] = s[i];
+            }
+        }
+
+        // an input's, from its impulse response
+        double s[N] = {};
+        double h[IIR_BLOCK];
+        double hs[IIR_BLOCK][N];
+        for (int k = 0; k < IIR_BLOCK; ++k) {
+            h[k] = step(s, (k == 0) ? 1.0 : 0.0);
+            for (int i = 0; i < N; ++i) {
+                hs[k][i] = s[i];
+            }
+        }
+        for (int m = 0; m < IIR_BLOCK; ++m) {
+            for (int k = 0; k < IIR_BLOCK; ++k) {
+                from_input[m][k] = (k >= m) ? h[k - m] : 0;
+            }
+            for (int i = 0; i < N; ++i) {
+                next_from_input[m][i] = hs[IIR_BLOCK - 1 - m][i];
+            }
+        }
+    }
+
+    // Filters the whole blocks of buf[0, n) in place, starting from state
+    // s and leaving s at the state after them. Returns how many samples
+    // that was; the caller runs the rest a sample at a time.
+
+    int process(float* s, float* buf, const int n) const {
+        const int end = n - n % IIR_BLOCK;
+        for (int start = 0; start < end; start += IIR_BLOCK) {
+            float* const u = buf + start;
+            float y[IIR_BLOCK] = {};
+            float next[N] = {};
+            // inputs first: they don't wait on the last block's state.
+            for (int m = 0; m < IIR_BLOCK; ++m) {
+                for (int k = 0; k < IIR_BLOCK; ++k) {
+                    y[k] += from_input[m][k] * u[m];
+                }
+                for (int i = 0; i < N; ++i) {
+                    next[i] += next_from_input[m][i] * u[m];
+                }
+            }
+            for (int j = 0; j < N; ++j) {
+                for (int k = 0; k < IIR_BLOCK; ++k) {
+                    y[k] += from_state[j][k] * s[j];
+                }
+                for (int i = 0; i < N; ++i) {
+                    next[i] += next_from_state[j][i] * s[j];
+                }
+            }
+            for (int k = 0; k < IIR_BLOCK; ++k) {
+                u[k] = y[k];
+            }
+            for (int i = 0; i < N; ++i) {
+                s[i] = next[i];
+            }
+        }
+        return end;
+    }
+
+private:
+    float from_state[N][IIR_BLOCK];
+    float from_input[IIR_BLOCK][IIR_BLOCK];
+    float next_from_state[N][N];
+    float next_from_input[IIR_BLOCK][N];
+};
+
+/* TwoPoleFilter is the resonant filter these plugins are built around: a
+ * two-pole lowpass then a two-pole highpass, each a pair of leaky
+ * integrators in a loop. c sets a stage's cutoff and one_minus_rc its
+ * damping. The lowpass passes its second integrator; the highpass takes
+ * its own away.
+ *
+ * Coefficients glide to a new setting over U samples in equal steps,
+ * worked out once when it's set. The block calls carry the ramp and the
+ * filter state in locals. One filter can run any number of signals, each
+ * with its own State. processLanes() runs several side by side, so the
+ * lanes vectorise; once settled, one to three lanes run through a
+ * BlockIir instead.
+ */
+template <int U = 2400> class TwoPoleFilter {
+public:
+
+    struct State {
+        float v0 = 0;
+        float v1 = 0;
+        float hv0 = 0;
+        float hv1 = 0;
+    };
+
+    // Glides to coeffs' LPF and HPF constants (gain is left to the caller).
+    // Setting the current target again doesn't restart the glide.
+
+    void set(const FilterCoeffs& coeffs) {
+        const Coeffs to = {coeffs.lc, coeffs.l_one_minus_rc, coeffs.hc, coeffs.h_one_minus_rc};
+        if (to.lc == end.lc && to.l_one_minus_rc == end.l_one_minus_rc &&
+                to.hc == end.hc && to.h_one_minus_rc == end.h_one_minus_rc) {
+            return;
+        }
+        end = to;
+#ifndef SERIAL_FILTERS
+        block_mode = -1;
+#endif
+        step.lc = (end.lc - now.lc) * inv_len;
+        step.l_one_minus_rc = (end.l_one_minus_rc - now.l_one_minus_rc) * inv_len;
+        step.hc = (end.hc - now.hc) * inv_len;
+        step.h_one_minus_rc = (end.h_one_minus_rc - now.h_one_minus_rc) * inv_len;
+        left = U;
+    }
+
+    // Jumps to the target.
+
+    void complete() {
+        now = end;
+        left = 0;
+    }
+
+    bool isSettled() const {
+        return left == 0;
+    }
+
+    // Per sample: run each signal's State through lowpass() and/or
+    // highpass(), then tick() once.
+
+    float lowpass(State& s, const float in) const {
+        s.v0 = now.l_one_minus_rc * s.v0 + now.lc * (in - s.v1);
+        s.v1 = now.l_one_minus_rc * s.v1 + now.lc * s.v0;
+        return s.v1;
+    }
+
+    float highpass(State& s, const float in) const {
+        s.hv0 = now.h_one_minus_rc * s.hv0 + now.hc * (in - s.hv1);
+        s.hv1 = now.h_one_minus_rc * s.hv1 + now.hc * s.hv0;
+        return in - s.hv1;
+    }
+
+    void tick() {
+        if (left > 0) {
+            stepCoeffs(now);
+            if (--left == 0) {
+                now = end;
+            }
+        }
+    }
+
+    // Runs buf[0, n) through the stages picked by LOW and HIGH, in place,
+    // and advances n samples.
+
+    template <bool LOW, bool HIGH> void process(State& s, float* buf, const int n) {
+        processLanes<LOW, HIGH, 1>(&s, &buf, 1, n);
+    }
+
+    // process() for up to LANES signals at once: lane l is states[l] and
+    // bufs[l][0, n).
+
+    template <bool LOW, bool HIGH, int LANES>
+    void processLanes(State* states, float* const* bufs, const int lanes, const int n) {
+        float v0[LANES], v1[LANES], hv0[LANES], hv1[LANES];
+        for (int l = 0; l < lanes; ++l) {
+            v0[l] = states[l].v0;
+            v1[l] = states[l].v1;
+            hv0[l] = states[l].hv0;
+            hv1[l] = states[l].hv1;
+        }
+
+        // the glide's part of the block, then the rest at the target.
+        Coeffs k = now;
+        const int ramp = (n < left) ? n : left;
+        int i = 0;
+        for (; i < ramp; ++i) {
+            runSample<LOW, HIGH>(k, v0, v1, hv0, hv1, bufs, lanes, i);
+            stepCoeffs(k);
+        }
+        left -= ramp;
+        if (left == 0) {
+            k = end;
+        }
+#ifndef SERIAL_FILTERS
+        // Settled, a few lanes run a block at a time; more already
+        // vectorise across lanes.
+        if (left == 0 && lanes < 4 && n - i >= IIR_BLOCK) {
+            buildBlock<LOW, HIGH>();
+            int done = i;
+            for (int l = 0; l < lanes; ++l) {
+                float s[4] = {v0[l], v1[l], hv0[l], hv1[l]};
+                done = i + block.process(s, bufs[l] + i, n - i);
+                v0[l] = s[0];
+                v1[l] = s[1];
+                hv0[l] = s[2];
+                hv1[l] = s[3];
+            }
+            i = done;
+        }
+#endif
+        for (; i < n; ++i) {
+            runSample<LOW, HIGH>(k, v0, v1, hv0, hv1, bufs, lanes, i);
+        }
+        now = k;
+
+        for (int l = 0; l < lanes; ++l) {
+            states[l].v0 = v0[l];
+            states[l].v1 = v1[l];
+            states[l].hv0 = hv0[l];
+            states[l].hv1 = hv1[l];
+        }
+    }
+
+private:
+
+    struct Coeffs {
+        float lc;
+        float l_one_minus_rc;
+        float hc;
+        float h_one_minus_rc;
+    };
+
+    void stepCoeffs(Coeffs& k) const {
+        k.lc += step.lc;
+        k.l_one_minus_rc += step.l_one_minus_rc;
+        k.hc += step.hc;
+        k.h_one_minus_rc += step.h_one_minus_rc;
+    }
+
+#ifndef SERIAL_FILTERS
+    // Builds block for the target constants and the stages picked by LOW
+    // and HIGH, unless it already has them.
+
+    template <bool LOW, bool HIGH> void buildBlock() {
+        const int mode = (LOW ? 1 : 0) + (HIGH ? 2 : 0);
+        if (block_mode == mode) {
+            return;
+        }
+        const Coeffs k = end;
+        block.build([k](double* s, const double in) {
+            double curr = in;
+            if (LOW) {
+                s[0] = k.l_one_minus_rc * s[0] + k.lc * (curr - s[1]);
+                s[1] = k.l_one_minus_rc * s[1] + k.lc * s[0];
+                curr = s[1];
+            }
+            if (HIGH) {
+                s[2] = k.h_one_minus_rc * s[2] + k.hc * (curr - s[3]);
+                s[3] = k.h_one_minus_rc * s[3] + k.hc * s[2];
+                curr = curr - s[3];
+            }
+            return curr;
+        });
+        block_mode = mode;
+    }
+#endif
+
+    template <bool LOW, bool HIGH>
+    static void runSample(const Coeffs& k, float* v0, float* v1, float* hv0, float* hv1,
+            float* const* bufs, const int lanes, const int i) {
+        for (int l = 0; l < lanes; ++l) {
+            float curr = bufs[l][i];
+            if (LOW) {
+                v0[l] = k.l_one_minus_rc * v0[l] + k.lc * (curr - v1[l]);
+                v1[l] = k.l_one_minus_rc * v1[l] + k.lc * v0[l];
+                curr = v1[l];
+            }
+            if (HIGH) {
+                hv0[l] = k.h_one_minus_rc * hv0[l] + k.hc * (curr - hv1[l]);
+                hv1[l] = k.h_one_minus_rc * hv1[l] + k.hc * hv0[l];
+                curr = curr - hv1[l];
+            }
+            bufs[l][i] = curr;
+        }
+    }
+
+    Coeffs now = {0.3, 0.98, 0.3, 0.98};
+    Coeffs end = now;
+    Coeffs step = {0, 0, 0, 0};
+    int left = 0;
+    static constexpr float inv_len = 1.0f / U;
+#ifndef SERIAL_FILTERS
+    BlockIir<4> block;
+    int block_mode = -1;   // stages block was built for; -1 if stale
+#endif
+};
+
+/* ControlClock runs control-rate work (LFO steps, coefficient updates,
+ * parameter ramps) every CONTROL_LEN samples, on a clock that carries over
+ * from one run() to the next, so how often it happens doesn't depend on the
+ * host's block size. A run() splits its frames at the ticks:
+ *
+ *     for (uint32_t i = 0; i < frames;) {
+ *         if (control_.due()) { ...control-rate work... }
+ *         const int n = control_.span(frames - i);
+ *         ...process n samples...
+ *         control_.advance(n);
+ *         i += n;
+ *     }
+ */
+const int CONTROL_LEN = 32;
+
+class ControlClock {
+public:
+
+    // True if a control tick falls on the next sample.
+
+    bool due() const {
+        return phase == 0;
+    }
+
+    // Samples from here up to the next tick, at most n.
+
+    int span(const int n) const {
+        return (n < CONTROL_LEN - phase) ? n : CONTROL_LEN - phase;
+    }
+
+    // Moves the clock on n samples. n can cross ticks, for callers that
+    // had no control-rate work to do.
+
+    void advance(const uint32_t n) {
+        phase = (phase + n) % CONTROL_LEN;
+    }
+
+private:
+    int phase = 0;
 };
 
 #endif
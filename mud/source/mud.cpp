@@ -140,6 +140,43 @@ void MudPlugin::setParameterValue(uint32_t index, float value) {
     }
 }
 
+namespace {
+
+    // The Filter knob's mapping, tabulated for the LFO to sweep. Shared by
+    // all instances; built by the first one constructed.
+
+    FilterTable<> filter_table;
+
+    FilterCoeffs filterCoeffs(const float filter) {
+        // calc params from meta-param
+        const float filter_res = 5.0 + ((int) filter / 2.0);
+        const float filter_cutoff = 5.0 + fabs(fabs(160.0 - 3.2 * filter) - 80.0);
+
+        FilterCoeffs out;
+        out.gain = 3.0 - fabs(fabs(160.0 - 3.2 * filter) - 80.0) / 40.0;
+
+        // set up R/C constants
+        out.lc = powf(0.5, 4.6 - (filter_cutoff / 27.2));
+        const float lr = powf(0.5, -0.6 + filter_res / 40.0);
+        out.l_one_minus_rc = 1.0 - (lr * out.lc);
+
+        out.hc = powf(0.5, 4.6 + (filter_cutoff / 34.8));
+        const float hr = powf(0.5, 3.0 - (filter_res / 63.5));
+        out.h_one_minus_rc = 1.0 - (hr * out.hc);
+        return out;
+    }
+
+    bool buildFilterTable() {
+        filter_table.build(filterCoeffs);
+        return true;
+    }
+}
+
+void MudPlugin::initFilterTable() {
+    static const bool built = buildFilterTable();
+    (void) built;
+}
+
 void MudPlugin::fixFilterParams() {
     // LFO - deadzone from [-10,10]
     float lfo_depth = 0;
@@ -148,32 +185,26 @@ void MudPlugin::fixFilterParams() {
     } else if (lfo_ > 10) {
         lfo_depth = 10;
     }
-    float lfo_rate = fmax(fabs(lfo_) - 10.0, 0) * 0.0002;
+    float lfo_rate = fmax(fabs(lfo_) - 10.0, 0) * 0.0002 * CONTROL_LEN / VOICED_BLOCK;
     if (lfo_ < 0) { // faster on -ve side
         lfo_rate *= 3.0;
     }
-    lfo_counter_ += 1;
+    lfo_osc_.setRate(lfo_rate);
 
-    float new_filter = filter_ + lfo_depth * sin(lfo_rate * lfo_counter_);
+    float new_filter = filter_ + lfo_depth * lfo_osc_.next();
     new_filter = fmin(fmax(new_filter, 0), 100); // clamp
-    new_filter = new_filter * 0.1 + prv_filter_ * 0.9; // LERP to new filter value
+    new_filter = new_filter * FILTER_GLIDE + prv_filter_ * (1.0 - FILTER_GLIDE); // LERP to new filter value
     prv_filter_ = new_filter;
 
-    // calc params from meta-param
-    filter_res_ = 5.0 + ((int) new_filter / 2.0);
-    filter_cutoff_ = 5.0 + fabs(fabs(160.0 - 3.2 * new_filter) - 80.0);
-    filter_gain_comp_ = 3.0 - fabs(fabs(160.0 - 3.2 * new_filter) - 80.0) / 40.0;
-
-    // set up R/C constants
-    float lc = powf(0.5, 4.6 - (filter_cutoff_ / 27.2));
-    lpf_.c = lc;
-    float lr = powf(0.5, -0.6 + filter_res_ / 40.0);
-    lpf_.one_minus_rc = 1.0 - (lr * lc);
-
-    float hc = powf(0.5, 4.6 + (filter_cutoff_ / 34.8));
-    hpf_.c = hc;
-    float hr = powf(0.5, 3.0 - (filter_res_ / 63.5));
-    hpf_.one_minus_rc = 1.0 - (hr * hc);
+    // nothing to do once the LERP has landed and the LFO is off.
+    if (new_filter == fixed_filter_) {
+        return;
+    }
+    fixed_filter_ = new_filter;
+
+    const FilterCoeffs coeffs = filter_table.lookup(new_filter);
+    filter_gain_comp_ = coeffs.gain;
+    filters_.set(coeffs);
 }
 
 /**
@@ -183,52 +214,58 @@ void MudPlugin::run(const float** inputs, float** outputs, uint32_t frames) {
     const float* const left_input = inputs[0];
     /* */ float* const left_output = outputs[0];
 
-    // once per block
-    fixFilterParams();
-
-    for (uint32_t i = 0; i < frames; ++i) {
-        left_output[i] = process(left_, left_input[i]);
-        tick();
+    // chunks end at control ticks, where the LFO and filter are updated.
+    for (uint32_t i = 0; i < frames;) {
+        if (control_.due()) {
+            fixFilterParams();
+        }
+        const int n = control_.span(frames - i); // never more than BLOCK_LEN
+        const signal_t* const in = left_input + i;
+        signal_t wet[BLOCK_LEN];
+        processWet(in, wet, n);
+        mix(in, wet, left_output + i, n);
+        control_.advance(n);
+        i += n;
     }
 }
 
-signal_t MudPlugin::process(Channel& ch, const signal_t in) {
-    signal_t curr = preSaturate(in);
-    curr = filterLPF(ch, curr);
-    curr = filterHPF(ch, curr);
-    curr = postSaturate(curr);
-    curr = ch.dc_filter.process(curr);
+// Runs the wet path over n samples: all of Mud but the mix.
 
-    if (mix_ < 0.5) {
-        // dry full vol, fade in wet
-        return in + 2.0 * mix_ * curr;
-    } else {
-        // wet full vol, fade out dry
-        return curr + 2.0 * (1.0 - mix_) * in;
-    }
+void MudPlugin::processWet(const signal_t* in, signal_t* out, const int n) {
+    PRE_SATURATOR.processBlock(in, out, n);
+    filters_.process<true, true>(left_.filter, out, n);
+    POST_SATURATOR.processBlock(out, out, n);
+    left_.dc_filter.processBlock(out, out, n);
+    filter_gain_comp_.tickBlock(n);
 }
 
-signal_t MudPlugin::preSaturate(const signal_t in) const {
-    signal_t curr = (1.0 + PRE_SHAPER) * in / (1.0 + PRE_SHAPER * fabs(in));
-    return fmax(fmin(curr, CLAMP), -CLAMP);
-}
-
-signal_t MudPlugin::postSaturate(const signal_t in) const {
-    return (1.0 + POST_SHAPER)*in / (1.0 + POST_SHAPER * fabs(in));
-}
-
-// Applies a bandpass filter to the current sample.
-
-float MudPlugin::filterLPF(Channel& ch, const float in) const {
-    ch.v0 = (lpf_.one_minus_rc) * ch.v0 + lpf_.c * (in - ch.v1);
-    ch.v1 = (lpf_.one_minus_rc) * ch.v1 + lpf_.c * ch.v0;
-    return ch.v1;
-}
-
-float MudPlugin::filterHPF(Channel& ch, const float in) const {
-    ch.hv0 = (hpf_.one_minus_rc) * ch.hv0 + hpf_.c * (in - ch.hv1);
-    ch.hv1 = (hpf_.one_minus_rc) * ch.hv1 + hpf_.c * ch.hv0;
-    return in - ch.hv1;
+// Mixes n samples of the wet path's output into the dry signal.
+
+void MudPlugin::mix(const signal_t* dry, const signal_t* wet, signal_t* out, const int n) {
+    if (mix_.isSettled()) {
+        if (mix_ < 0.5) {
+            // dry full vol, fade in wet
+            const float gain = 2.0 * mix_;
+            for (int i = 0; i < n; ++i) {
+                out[i] = dry[i] + gain * wet[i];
+            }
+        } else {
+            // wet full vol, fade out dry
+            const float gain = 2.0 * (1.0 - mix_);
+            for (int i = 0; i < n; ++i) {
+                out[i] = wet[i] + gain * dry[i];
+            }
+        }
+    } else {
+        for (int i = 0; i < n; ++i) {
+            if (mix_ < 0.5) {
+                out[i] = dry[i] + 2.0 * mix_ * wet[i];
+            } else {
+                out[i] = wet[i] + 2.0 * (1.0 - mix_) * dry[i];
+            }
+            mix_.tick();
+        }
+    }
 }
 
 // Per-channel processing.
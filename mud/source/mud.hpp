@@ -35,6 +35,16 @@
 const float PRE_SHAPER = 0.4;
 const float POST_SHAPER = 0.8;
 const float CLAMP = 0.98;
+const RationalShaper PRE_SATURATOR(PRE_SHAPER, CLAMP);
+const RationalShaper POST_SATURATOR(POST_SHAPER);
+
+const int BLOCK_LEN = 64; // longest run through the wet path at a time
+
+// The LFO rate and filter glide were voiced for one update per 256-sample
+// host block. Updates now happen every control tick, so they're scaled to
+// match.
+const int VOICED_BLOCK = 256;
+const float FILTER_GLIDE = 1.0 - pow(0.9, (double) CONTROL_LEN / VOICED_BLOCK);
 
 const int NUM_PROGRAMS = 6;
 
@@ -48,14 +58,14 @@ public:
         PARAM_COUNT
     };
 
+    // the bandpass filter; coefficients glide over 128 samples.
+    typedef TwoPoleFilter<128> Filter;
+
     struct Channel {
     public:
 
         // filter state
-        float v0 = 0;
-        float v1 = 0;
-        float hv0 = 0;
-        float hv1 = 0;
+        Filter::State filter;
 
         // DC filter
         DcFilter dc_filter;
@@ -65,15 +75,6 @@ public:
         }
     };
 
-    struct Filter {
-        SmoothParam<float, 128> c = 0.3;
-        SmoothParam<float, 128> one_minus_rc = 0.98;
-
-        void tick() {
-            c.tick();
-            one_minus_rc.tick();
-        }
-    };
 
     /**
       Plugin class constructor.
@@ -81,6 +82,7 @@ public:
      */
     MudPlugin() : Plugin(PARAM_COUNT, NUM_PROGRAMS, 0) {
         srate = getSampleRate();
+        initFilterTable();
         loadProgram(0);
     };
 
@@ -180,19 +182,16 @@ protected:
     void run(const float** inputs, float** outputs, uint32_t frames) override;
 
 private:
+    static void initFilterTable();
     void fixFilterParams();
     void fixLfoParams();
 
-    signal_t preSaturate(const signal_t in) const;
-    signal_t postSaturate(const signal_t in) const;
     signal_t filterDC(Channel& ch, const signal_t in) const;
-    signal_t filterLPF(Channel& ch, const signal_t in) const;
-    signal_t filterHPF(Channel& ch, const signal_t in) const;
-    signal_t process(Channel& ch, const signal_t in);
+    void processWet(const signal_t* in, signal_t* out, const int n);
+    void mix(const signal_t* dry, const signal_t* wet, signal_t* out, const int n);
 
     Channel left_;
-    Filter lpf_;
-    Filter hpf_;
+    Filter filters_;
 
     // params
     // gain
@@ -200,25 +199,17 @@ private:
 
     // LFO
     float lfo_ = 0;
-    long lfo_counter_ = 0;
+    Lfo lfo_osc_; // steps once per control tick
     float prv_filter_ = 0;
+    float fixed_filter_ = -1; // the filter value the coefficients are set for
 
     // filter
     float filter_ = 0;
-    float filter_cutoff_ = 0;
-    float filter_res_ = 0;
     SmoothParam<float, 128> filter_gain_comp_ = 1.0;
 
     //
     samples_t srate;
-
-    void tick() {
-        mix_.tick();
-        lpf_.tick();
-        hpf_.tick();
-        left_.tick();
-        filter_gain_comp_.tick();
-    }
+    ControlClock control_;
 };
 
 #endif // MUD_HPP
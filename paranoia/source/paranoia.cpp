@@ -28,6 +28,10 @@ Paranoia is a bit crusher, distortion, resampler and mangler.
 #include "paranoia.hpp"
 #include "math.h"
 
+constexpr int Mangler::clear_masks_[];
+constexpr int Mangler::xor_masks_[];
+constexpr float Mangler::relgain_[];
+
 void ParanoiaPlugin::initProgramName(uint32_t index, String& programName) {
     static const char* names[] = {"grit", "more grit", "gated fuzz", "lofi", "invert", "lupine"};
     if (index < 6) {
@@ -47,8 +51,7 @@ void ParanoiaPlugin::loadProgram(uint32_t index) {
     };
 
     if (index < 6) {
-        left_.sample_csr = 0;
-        left_.next_sample = 0;
+        left_.hold_left = 0;
 
         setParameterValue(PARAM_THERMONUCLEAR_WAR, params[index][2]);
         bitscale_.complete();
@@ -199,15 +202,15 @@ void ParanoiaPlugin::fixFilterParams() {
     }
 
     // set up R/C constants
-    float lc = powf(0.5, 4.6 - (filter_cutoff_ / 27.2));
-    lpf_.c = lc;
+    FilterCoeffs coeffs;
+    coeffs.lc = powf(0.5, 4.6 - (filter_cutoff_ / 27.2));
     float lr = powf(0.5, -0.6 + filter_res_ / 40.0);
-    lpf_.one_minus_rc = 1.0 - (lr * lc);
+    coeffs.l_one_minus_rc = 1.0 - (lr * coeffs.lc);
 
-    float hc = powf(0.5, 4.6 + (filter_cutoff_ / 34.8));
-    hpf_.c = hc;
+    coeffs.hc = powf(0.5, 4.6 + (filter_cutoff_ / 34.8));
     float hr = powf(0.5, 3.0 - (filter_res_ / 43.5));
-    hpf_.one_minus_rc = 1.0 - (hr * hc);
+    coeffs.h_one_minus_rc = 1.0 - (hr * coeffs.hc);
+    filters_.set(coeffs);
 }
 
 /**
@@ -217,26 +220,151 @@ void ParanoiaPlugin::run(const float** inputs, float** outputs, uint32_t frames)
     const float* const left_input = inputs[0];
     /* */ float* const left_output = outputs[0];
 
-    for (uint32_t i = 0; i < frames; ++i) {
-        left_output[i] = process(left_, left_input[i]);
-        tick();
+    // filter mode and resampler state only change in setParameterValue, so
+    // pick a specialised kernel once per block.
+    if (resample_hz_ < RESAMPLE_MAX) {
+        switch (filter_mode_) {
+            case MODE_OFF:
+                runKernel<MODE_OFF, true>(left_input, left_output, frames);
+                break;
+            case MODE_LPF:
+                runKernel<MODE_LPF, true>(left_input, left_output, frames);
+                break;
+            case MODE_BANDPASS:
+                runKernel<MODE_BANDPASS, true>(left_input, left_output, frames);
+                break;
+            case MODE_HPF:
+                runKernel<MODE_HPF, true>(left_input, left_output, frames);
+                break;
+        }
+    } else {
+        switch (filter_mode_) {
+            case MODE_OFF:
+                runKernel<MODE_OFF, false>(left_input, left_output, frames);
+                break;
+            case MODE_LPF:
+                runKernel<MODE_LPF, false>(left_input, left_output, frames);
+                break;
+            case MODE_BANDPASS:
+                runKernel<MODE_BANDPASS, false>(left_input, left_output, frames);
+                break;
+            case MODE_HPF:
+                runKernel<MODE_HPF, false>(left_input, left_output, frames);
+                break;
+        }
+    }
+}
+
+template <ParanoiaPlugin::FilterMode MODE, bool RESAMPLE>
+void ParanoiaPlugin::runKernel(const float* in, float* out, uint32_t frames) {
+    if (isSettled()) {
+        // nothing is ramping: one pass with the gain hoisted out.
+        const float gain = filter_gain_comp_ * DB_CO(wet_out_db_);
+        transfer_dirty_ |= mangler_.setPattern(nuclear_, bitdepth_, bitscale_);
+        if (MODE == MODE_OFF) {
+            fixTransferCurve(gain);
+        }
+        processBlock<MODE, RESAMPLE>(left_, in, out, frames, gain);
+        control_.advance(frames);
+        return;
+    }
+
+    // ramping: params step a control period at each tick and hold between,
+    // so each run between ticks is processed like a settled block.
+    for (uint32_t i = 0; i < frames;) {
+        if (control_.due()) {
+            tickBlock(CONTROL_LEN);
+        }
+        const int n = control_.span(frames - i);
+        const float gain = filter_gain_comp_ * DB_CO(wet_out_db_);
+        const bool gain_settled = wet_out_db_.isSettled() && filter_gain_comp_.isSettled();
+        if (nuclear_.isSettled() && bitscale_.isSettled() && (MODE != MODE_OFF || gain_settled)) {
+            transfer_dirty_ |= mangler_.setPattern(nuclear_, bitdepth_, bitscale_);
+            if (MODE == MODE_OFF) {
+                fixTransferCurve(gain);
+            }
+            processBlock<MODE, RESAMPLE>(left_, in + i, out + i, n, gain);
+        } else {
+            // the crush table (or transfer curve) would be rebuilt every
+            // tick, so crush each sample directly instead.
+            for (int k = 0; k < n; ++k) {
+                out[i + k] = process<MODE, RESAMPLE>(left_, in[i + k], gain);
+                filters_.tick();
+            }
+        }
+        control_.advance(n);
+        i += n;
     }
 }
 
-signal_t ParanoiaPlugin::process(Channel& ch, const signal_t in) {
+// Block kernel, for runs where no param moves. Runs the chain a stage at a
+// time over sub-blocks so the memoryless stages vectorise; only the
+// resampler, filters and DC filter are sample-serial.
+
+template <ParanoiaPlugin::FilterMode MODE, bool RESAMPLE>
+void ParanoiaPlugin::processBlock(Channel& ch, const float* in, float* out, uint32_t frames, const float gain) {
+    float buf[BLOCK_LEN];
+    for (uint32_t start = 0; start < frames; start += BLOCK_LEN) {
+        const int n = (frames - start < (uint32_t) BLOCK_LEN) ? frames - start : BLOCK_LEN;
+
+        resampleBlock<RESAMPLE>(ch, in + start, buf, n);
+
+        PRE_SATURATOR.processBlock(buf, buf, n);
+
+        if (MODE == MODE_OFF) {
+            // filter off: everything up to the DC filter is the transfer curve.
+            for (int i = 0; i < n; ++i) {
+                buf[i] = transfer_[mangler_.code(buf[i])];
+            }
+        } else {
+            mangler_.lookupBlock(buf, buf, n);
+
+            // one loop for both filters, so the two recurrences interleave.
+            filters_.process<MODE == MODE_LPF || MODE == MODE_BANDPASS,
+                    MODE == MODE_HPF || MODE == MODE_BANDPASS>(ch.filter, buf, n);
+
+            for (int i = 0; i < n; ++i) {
+                buf[i] *= gain; // boost before post-saturate
+            }
+            POST_SATURATOR.processBlock(buf, buf, n);
+        }
+
+        ch.dc_filter.processBlock(buf, out + start, n);
+    }
+}
+
+// With the filter off, everything between the pre-saturator and the DC
+// filter is memoryless and piecewise constant over crush codes, so it's baked
+// into one table. Rebuilt only when the crush table or gain changes; crush
+// and gain ramps run the full chain, so swapping this in when they settle
+// is seamless.
+
+void ParanoiaPlugin::fixTransferCurve(const float gain) {
+    if (!transfer_dirty_ && gain == transfer_gain_) {
+        return;
+    }
+    transfer_dirty_ = false;
+    transfer_gain_ = gain;
+    for (int code = 0; code < mangler_.codeCount(); ++code) {
+        transfer_[code] = POST_SATURATOR(gain * mangler_.lookupCode(code));
+    }
+}
+
+template <ParanoiaPlugin::FilterMode MODE, bool RESAMPLE>
+signal_t ParanoiaPlugin::process(Channel& ch, const signal_t in, const float gain) {
     signal_t curr = in; // pregain(ch, in);
-    curr = resample(ch, curr);
-    curr = preSaturate(curr);
+    curr = resample<RESAMPLE>(ch, curr);
+    curr = PRE_SATURATOR(curr);
     curr = bitcrush(curr);
 
-    if (filter_mode_ == MODE_LPF || filter_mode_ == MODE_BANDPASS) {
-        curr = filterLPF(ch, curr);
+    if (MODE == MODE_LPF || MODE == MODE_BANDPASS) {
+        curr = filters_.lowpass(ch.filter, curr);
     }
-    if (filter_mode_ == MODE_HPF || filter_mode_ == MODE_BANDPASS) {
-        curr = filterHPF(ch, curr);
+    if (MODE == MODE_HPF || MODE == MODE_BANDPASS) {
+        curr = filters_.highpass(ch.filter, curr);
     }
-    curr = filter_gain_comp_ * DB_CO(wet_out_db_) * curr; // boost before post-saturate
-    curr = postSaturate(curr);
+    curr = gain * curr; // boost before post-saturate
+    curr = POST_SATURATOR(curr);
     curr = ch.dc_filter.process(curr);
     return curr;
 }
@@ -246,65 +374,65 @@ signal_t ParanoiaPlugin::pregain(const Channel& ch, const signal_t in) const {
 }
 
 // resample is a dodgy resampler that sounds cool.
+// Without RESAMPLE it's bypassed (far-right on the crush knob).
 
+template <bool RESAMPLE>
 signal_t ParanoiaPlugin::resample(Channel& ch, const signal_t in) const {
-    ch.sample_csr += 1;
-    if (ch.sample_csr < ch.next_sample && resample_hz_ < RESAMPLE_MAX) {
+    if (!RESAMPLE) {
+        ch.hold_left = 0;
+        ch.prev_in = in;
+        return in;
+    }
+    ch.hold_left -= RESAMPLE_ONE;
+    if (ch.hold_left > 0) {
         return ch.prev_in;
     } else {
-        ch.next_sample += per_sample_;
-        if (resample_hz_ == RESAMPLE_MAX) {
-            ch.sample_csr = ch.next_sample;
-        }
+        ch.hold_left += (int64_t) (per_sample_ * RESAMPLE_ONE);
         ch.prev_in = in;
         return in;
     }
 }
 
-signal_t ParanoiaPlugin::bitcrush(const signal_t in) const {
-    // boost from [-1, 1] to [0, 2^bitdepth) and truncate.
-    float curr = (1.0 + in) * (float) bitscale_;
-
-    // truncate
-    curr = (int) curr;
-
-    // Mangle (interpolating between L and R settings on mangle knob.
-    float nuclear_l = (int) nuclear_;
-    float mix = nuclear_ - nuclear_l;
-    float nuclear_r = nuclear_l + ((mix > 0.001) ? 1 : 0);
-    signal_t left = mangler_.mangleForBitDepth(nuclear_l, bitdepth_, curr);
-    signal_t right = mangler_.mangleForBitDepth(nuclear_r, bitdepth_, curr);
-    curr = left * (1.0 - mix) + right * mix;
-
-    // Return to [-1, 1] range.
-    curr = (curr / (float) bitscale_) - 1.0;
-    float gain_l = mangler_.relgain(nuclear_l);
-    float gain_r = mangler_.relgain(nuclear_r);
-    float gain = gain_l * (1.0 - mix) + gain_r * mix;
-    return curr * gain;
-}
-
-signal_t ParanoiaPlugin::preSaturate(const signal_t in) const {
-    signal_t curr = (1.0 + PRE_SHAPER) * in / (1.0 + PRE_SHAPER * fabs(in));
-    return fmax(fmin(curr, CLAMP), -CLAMP);
-}
-
-signal_t ParanoiaPlugin::postSaturate(const signal_t in) const {
-    return (1.0 + POST_SHAPER)*in / (1.0 + POST_SHAPER * fabs(in));
-}
+// Block version for a constant rate: works out where each hold run ends
+// and fills runs in one go, rather than testing every sample.
 
-// Applies a bandpass filter to the current sample.
+template <bool RESAMPLE>
+void ParanoiaPlugin::resampleBlock(Channel& ch, const signal_t* in, signal_t* out, const int n) const {
+    if (!RESAMPLE) {
+        memcpy(out, in, n * sizeof (signal_t));
+        ch.hold_left = 0;
+        ch.prev_in = in[n - 1];
+        return;
+    }
+    const int64_t per_sample = per_sample_ * RESAMPLE_ONE;
+    int64_t hold_left = ch.hold_left;
+    signal_t prev_in = ch.prev_in;
+
+    int i = 0;
+    while (i < n) {
+        // whole samples still to hold before the next capture.
+        const int64_t held = (hold_left > 0) ? ((hold_left - 1) >> RESAMPLE_FRAC_BITS) : 0;
+        const int run = (held < n - i) ? held : n - i;
+        for (int j = 0; j < run; ++j) {
+            out[i + j] = prev_in;
+        }
+        hold_left -= (int64_t) run << RESAMPLE_FRAC_BITS;
+        i += run;
+
+        if (i < n) {
+            hold_left += per_sample - RESAMPLE_ONE;
+            prev_in = in[i];
+            out[i] = prev_in;
+            i += 1;
+        }
+    }
 
-float ParanoiaPlugin::filterLPF(Channel& ch, const float in) const {
-    ch.v0 = (lpf_.one_minus_rc) * ch.v0 + lpf_.c * (in - ch.v1);
-    ch.v1 = (lpf_.one_minus_rc) * ch.v1 + lpf_.c * ch.v0;
-    return ch.v1;
+    ch.hold_left = hold_left;
+    ch.prev_in = prev_in;
 }
 
-float ParanoiaPlugin::filterHPF(Channel& ch, const float in) const {
-    ch.hv0 = (hpf_.one_minus_rc) * ch.hv0 + hpf_.c * (in - ch.hv1);
-    ch.hv1 = (hpf_.one_minus_rc) * ch.hv1 + hpf_.c * ch.hv0;
-    return in - ch.hv1;
+signal_t ParanoiaPlugin::bitcrush(const signal_t in) const {
+    return Mangler::crush(in, nuclear_, bitdepth_, bitscale_);
 }
 
 // Per-channel processing.
@@ -34,21 +34,31 @@
 
 const samples_t RESAMPLE_MAX = 48000;
 
+// resampler position is 32.32 fixed-point, so it never drifts.
+const int RESAMPLE_FRAC_BITS = 32;
+const int64_t RESAMPLE_ONE = (int64_t) 1 << RESAMPLE_FRAC_BITS;
+
 // waveshapes
 const float PRE_SHAPER = 0.857;
 const float POST_SHAPER = 0.9;
 const float CLAMP = 0.9;
+const RationalShaper PRE_SATURATOR(PRE_SHAPER, CLAMP);
+const RationalShaper POST_SATURATOR(POST_SHAPER);
 
 const int NUM_PROGRAMS = 6;
 
+// sub-block length for the stage-wise kernels.
+const int BLOCK_LEN = 64;
+
 const int NUM_MANGLERS = 17;
 const int MANGLER_BITDEPTH = 8;
 
 
 // Bitcrusher.
 
-class Mangler {
-public:
+// Mangler bit patterns, one row of MANGLER_BITDEPTH per mangler.
+
+struct ManglePatterns {
 
     enum Mangle {
         X = -1, // invert
@@ -56,13 +66,45 @@ public:
         I = 1 // on
     };
 
-    Mangler() {
-        initMangler();
+    // Bit b of a mask reads column (8 - b) of its row, so bit 0 comes from
+    // the first column of the next row, and the trailing I stands in for
+    // the row after the last. That's how the patterns have always sounded.
+    static constexpr Mangle patterns[NUM_MANGLERS * MANGLER_BITDEPTH + 1] = {
+        I, I, I, I, I, I, I, I,
+        I, I, I, I, I, I, I, O,
+        I, I, I, I, I, I, I, X, //
+        I, I, I, I, I, I, O, I,
+        I, I, I, I, I, I, X, I,
+        I, I, I, I, I, O, O, I,
+        I, I, I, I, I, I, X, X,
+        I, I, I, X, I, I, I, I,
+        I, I, O, I, I, I, I, I,
+        O, X, I, O, X, O, X, I,
+        X, X, I, I, X, I, X, I,
+        O, O, O, O, I, O, O, O,
+        O, O, O, O, O, X, O, I,
+        O, O, I, I, O, O, X, I,
+        O, O, O, I, I, X, O, X,
+        O, O, O, O, I, I, X, X,
+        O, O, O, O, I, I, I, I,
+        I
     };
 
+    // Mask with a bit set wherever pattern idx has value m.
+
+    static constexpr int mask(const int idx, const Mangle m, const int bit = 0) {
+        return (bit == MANGLER_BITDEPTH) ? 0 :
+                ((patterns[idx * MANGLER_BITDEPTH + MANGLER_BITDEPTH - bit] == m) ? (1 << bit) : 0)
+                | mask(idx, m, bit + 1);
+    }
+};
+
+class Mangler {
+public:
+
     // works on samples in [0, 2^bitdepth) range
 
-    int mangleForBitDepth(const int pattern_idx, int bitdepth, const int in) const {
+    static int mangleForBitDepth(const int pattern_idx, int bitdepth, const int in) {
         int clear_mask = clear_masks_[pattern_idx];
         int xor_mask = xor_masks_[pattern_idx];
 
@@ -78,56 +120,120 @@ public:
         return curr;
     }
 
-    float relgain(const int pattern_idx) const {
+    static float relgain(const int pattern_idx) {
         return relgain_[pattern_idx];
     }
 
-private:
+    // Full crush for one sample in [-1, 1]: truncate to bitdepth, mangle
+    // (interpolating between patterns either side of a fractional nuclear),
+    // and return to [-1, 1] w/ gain compensation.
+
+    static float crush(const float in, const float nuclear, const int bitdepth, const float bitscale) {
+        // boost from [-1, 1] to [0, 2^bitdepth) and truncate.
+        const int code = (1.0f + in) * bitscale;
+        return crushCode(code, nuclear, bitdepth, bitscale);
+    }
+
+    static float crushCode(const int code, const float nuclear, const int bitdepth, const float bitscale) {
+        // Mangle (interpolating between L and R settings on mangle knob.
+        float nuclear_l = (int) nuclear;
+        float mix = nuclear - nuclear_l;
+        float nuclear_r = nuclear_l + ((mix > 0.001) ? 1 : 0);
+        signal_t left = mangleForBitDepth(nuclear_l, bitdepth, code);
+        signal_t right = mangleForBitDepth(nuclear_r, bitdepth, code);
+        float curr = left * (1.0 - mix) + right * mix;
+
+        // Return to [-1, 1] range.
+        curr = (curr / bitscale) - 1.0;
+        float gain_l = relgain(nuclear_l);
+        float gain_r = relgain(nuclear_r);
+        float gain = gain_l * (1.0 - mix) + gain_r * mix;
+        return curr * gain;
+    }
+
+    // Bakes crush() for every code at this setting into the lookup table.
+    // Cheap to call repeatedly; only rebuilds (and returns true) when
+    // something changed.
+
+    bool setPattern(const float nuclear, const int bitdepth, const float bitscale) {
+        if (nuclear == table_nuclear_ && bitdepth == table_bitdepth_ && bitscale == table_bitscale_) {
+            return false;
+        }
+        table_nuclear_ = nuclear;
+        table_bitdepth_ = bitdepth;
+        table_bitscale_ = bitscale;
+        table_max_ = (1 << bitdepth) - 1;
+
+        for (int code = 0; code <= table_max_; ++code) {
+            table_[code] = crushCode(code, nuclear, bitdepth, bitscale);
+        }
+        return true;
+    }
 
-    void initMangler() {
-        Mangle manglers[NUM_MANGLERS][MANGLER_BITDEPTH] = {
-            { I, I, I, I, I, I, I, I},
-            { I, I, I, I, I, I, I, O},
-            { I, I, I, I, I, I, I, X}, //
-            { I, I, I, I, I, I, O, I},
-            { I, I, I, I, I, I, X, I},
-            { I, I, I, I, I, O, O, I},
-            { I, I, I, I, I, I, X, X},
-            { I, I, I, X, I, I, I, I},
-            { I, I, O, I, I, I, I, I},
-            { O, X, I, O, X, O, X, I},
-            { X, X, I, I, X, I, X, I},
-            { O, O, O, O, I, O, O, O},
-            { O, O, O, O, O, X, O, I},
-            { O, O, I, I, O, O, X, I},
-            { O, O, O, I, I, X, O, X},
-            { O, O, O, O, I, I, X, X},
-            { O, O, O, O, I, I, I, I},
-        };
-
-
-        for (int idx = 0; idx < NUM_MANGLERS; ++idx) {
-            const auto pattern = manglers[idx];
-            int clear_mask = 0;
-            int xor_mask = 0;
-            for (int i = 0; i < 8; ++i) {
-                if (pattern[8 - i] == O) {
-                    clear_mask = clear_mask | (int) pow(2, i);
-                }
-                if (pattern[8 - i] == X) {
-                    xor_mask = xor_mask | (int) pow(2, i);
-                }
+    // Code for a sample in [-1, 1] at the last setPattern().
+
+    int code(const float in) const {
+        const int code = (1.0f + in) * table_bitscale_;
+        return (code < 0) ? 0 : ((code > table_max_) ? table_max_ : code);
+    }
+
+    int codeCount() const {
+        return table_max_ + 1;
+    }
+
+    // Table versions of crush() at the last setPattern(), for one code or
+    // a block of samples.
+
+    float lookupCode(const int code) const {
+        return table_[code];
+    }
+
+    void lookupBlock(const float* in, float* out, const int n) const {
+        // two passes so the code calculation vectorises; the second is a
+        // plain gather.
+        int codes[BLOCK_LEN];
+        for (int start = 0; start < n; start += BLOCK_LEN) {
+            const int len = (n - start < BLOCK_LEN) ? n - start : BLOCK_LEN;
+            for (int i = 0; i < len; ++i) {
+                codes[i] = code(in[start + i]);
+            }
+            for (int i = 0; i < len; ++i) {
+                out[start + i] = table_[codes[i]];
             }
-            clear_masks_[idx] = clear_mask;
-            xor_masks_[idx] = xor_mask;
         }
     }
 
-    int xor_masks_[NUM_MANGLERS];
-    int clear_masks_[NUM_MANGLERS];
+    static const int MAX_BITDEPTH = 10;
+    static const int MAX_CODES = 1 << MAX_BITDEPTH;
+
+private:
+
+    static constexpr int clear_masks_[NUM_MANGLERS] = {
+        ManglePatterns::mask(0, ManglePatterns::O), ManglePatterns::mask(1, ManglePatterns::O),
+        ManglePatterns::mask(2, ManglePatterns::O), ManglePatterns::mask(3, ManglePatterns::O),
+        ManglePatterns::mask(4, ManglePatterns::O), ManglePatterns::mask(5, ManglePatterns::O),
+        ManglePatterns::mask(6, ManglePatterns::O), ManglePatterns::mask(7, ManglePatterns::O),
+        ManglePatterns::mask(8, ManglePatterns::O), ManglePatterns::mask(9, ManglePatterns::O),
+        ManglePatterns::mask(10, ManglePatterns::O), ManglePatterns::mask(11, ManglePatterns::O),
+        ManglePatterns::mask(12, ManglePatterns::O), ManglePatterns::mask(13, ManglePatterns::O),
+        ManglePatterns::mask(14, ManglePatterns::O), ManglePatterns::mask(15, ManglePatterns::O),
+        ManglePatterns::mask(16, ManglePatterns::O)
+    };
+
+    static constexpr int xor_masks_[NUM_MANGLERS] = {
+        ManglePatterns::mask(0, ManglePatterns::X), ManglePatterns::mask(1, ManglePatterns::X),
+        ManglePatterns::mask(2, ManglePatterns::X), ManglePatterns::mask(3, ManglePatterns::X),
+        ManglePatterns::mask(4, ManglePatterns::X), ManglePatterns::mask(5, ManglePatterns::X),
+        ManglePatterns::mask(6, ManglePatterns::X), ManglePatterns::mask(7, ManglePatterns::X),
+        ManglePatterns::mask(8, ManglePatterns::X), ManglePatterns::mask(9, ManglePatterns::X),
+        ManglePatterns::mask(10, ManglePatterns::X), ManglePatterns::mask(11, ManglePatterns::X),
+        ManglePatterns::mask(12, ManglePatterns::X), ManglePatterns::mask(13, ManglePatterns::X),
+        ManglePatterns::mask(14, ManglePatterns::X), ManglePatterns::mask(15, ManglePatterns::X),
+        ManglePatterns::mask(16, ManglePatterns::X)
+    };
 
     // gain compensation for patterns in manglers
-    float relgain_[NUM_MANGLERS] = {
+    static constexpr float relgain_[NUM_MANGLERS] = {
         1.0, // 0
         1.0,
         1.0, // 2
@@ -146,6 +252,13 @@ private:
         0.5,
         0.5 // 16
     };
+
+    // lookup table for the current pattern/bitdepth.
+    float table_[MAX_CODES] = {};
+    float table_nuclear_ = -1;
+    int table_bitdepth_ = 0;
+    float table_bitscale_ = 0;
+    int table_max_ = 0;
 };
 
 class ParanoiaPlugin : public Plugin {
@@ -166,32 +279,22 @@ public:
         PARAM_COUNT
     };
 
+    // the LPF and HPF, run alone or in series for bandpass.
+    typedef TwoPoleFilter<> Filter;
+
     struct Channel {
         // filter state
-        float v0 = 0;
-        float v1 = 0;
-        float hv0 = 0;
-        float hv1 = 0;
+        Filter::State filter;
 
-        // resampler state
-        samples_frac_t next_sample = 0;
+        // resampler state: samples left to hold prev_in for, fixed-point.
+        int64_t hold_left = 0;
         signal_t prev_in = 0;
-        long sample_csr = 0;
 
         // DC filter
         DcFilter dc_filter;
 
     };
 
-    struct Filter {
-        SmoothParam<float> c = 0.3;
-        SmoothParam<float> one_minus_rc = 0.98;
-
-        void tick() {
-            c.tick();
-            one_minus_rc.tick();
-        }
-    };
 
     /**
       Plugin class constructor.
@@ -298,20 +401,19 @@ protected:
 private:
     void fixCrushParams();
     void fixFilterParams();
+    void fixTransferCurve(const float gain);
 
     signal_t pregain(const Channel& ch, const signal_t in) const;
-    signal_t resample(Channel& ch, const signal_t in) const;
+    template <bool RESAMPLE> signal_t resample(Channel& ch, const signal_t in) const;
+    template <bool RESAMPLE> void resampleBlock(Channel& ch, const signal_t* in, signal_t* out, const int n) const;
     signal_t bitcrush(const signal_t in) const;
-    signal_t preSaturate(const signal_t in) const;
-    signal_t postSaturate(const signal_t in) const;
     signal_t filterDC(Channel& ch, const signal_t in) const;
-    signal_t filterLPF(Channel& ch, const signal_t in) const;
-    signal_t filterHPF(Channel& ch, const signal_t in) const;
-    signal_t process(Channel& ch, const signal_t in);
+    template <FilterMode MODE, bool RESAMPLE> signal_t process(Channel& ch, const signal_t in, const float gain);
+    template <FilterMode MODE, bool RESAMPLE> void processBlock(Channel& ch, const float* in, float* out, uint32_t frames, const float gain);
+    template <FilterMode MODE, bool RESAMPLE> void runKernel(const float* in, float* out, uint32_t frames);
 
     Channel left_;
-    Filter lpf_;
-    Filter hpf_;
+    Filter filters_;
 
     // params
     // gain
@@ -336,17 +438,31 @@ private:
     SmoothParam<float> nuclear_ = 0;
     Mangler mangler_;
 
+    // filter-off transfer curve: everything from the bitcrusher to the DC
+    // filter, baked per crush code.
+    float transfer_[Mangler::MAX_CODES] = {};
+    float transfer_gain_ = 0;
+    bool transfer_dirty_ = true;
+
     //
     samples_t srate;
+    ControlClock control_;
+
+    // Smoothed params step at the control rate: n samples at a time, at
+    // control ticks. filters_ glides itself, a sample at a time.
+    void tickBlock(const int n) {
+        wet_out_db_.tickBlock(n);
+        per_sample_.tickBlock(n);
+        filter_gain_comp_.tickBlock(n);
+        bitscale_.tickBlock(n);
+        nuclear_.tickBlock(n);
+    }
 
-    void tick() {
-        wet_out_db_.tick();
-        per_sample_.tick();
-        filter_gain_comp_.tick();
-        bitscale_.tick();
-        nuclear_.tick();
-        lpf_.tick();
-        hpf_.tick();
+    // true if no smoothed param is ramping.
+    bool isSettled() const {
+        return wet_out_db_.isSettled() && per_sample_.isSettled() &&
+                filter_gain_comp_.isSettled() && bitscale_.isSettled() &&
+                nuclear_.isSettled();
     }
 };
 